@@ -20,6 +20,11 @@
  * THE SOFTWARE.
  */
 #define DO_DEBUG 1
+#ifndef DO_SWEEP
+  #define DO_SWEEP 0 // 1: step through fsamps[] at each new file and report throughput (host: tools/app_sim)
+#endif
+#define DO_PROF 0  // 1: report CPU cycles per stage (interrupt, copy, dsp, write, idle) per file
+#define DO_BENCH 0 // 1: report CPU cycles of processing kernels and file system write rate at start-up
 
 #include "core_pins.h"
 #if DO_DEBUG==0
@@ -28,7 +33,9 @@
 #include "Wire.h"
 
 #define FSI 5// desired sampling frequency index
-#define MAX_FSI 6
+#ifndef MAX_FSI
+  #define MAX_FSI 6 // highest selectable rate (menu, DO_SWEEP)
+#endif
 uint32_t fsamps[] = {8000, 16000, 32000, 44100, 48000, 96000, 192000, 220500, 240000};
 
 float audio_srate = fsamps[FSI];
@@ -39,32 +46,192 @@ int isf = FSI;
  *      AudioProcessorUsage and AudioProcessorUsageMax
  * defined in stock AudioStream.h
  */
-#define NCH 1 // number of channels
-#define SEL_LR 1  // record only a single channel (0 left, 1 right)
+#ifndef NCH
+  #define NCH 1 // number of channels (1, 2)
+#endif
+#define SEL_LR 1  // record only a single channel (0 left, 1 right), if NCH==1
+#ifndef NBITS
+  #define NBITS 16 // bits per sample (16, 24), 24 bit needs ZERO_COPY
+#endif
+#define SAMPLE_BYTES (NBITS/8)
 
+#ifndef ZERO_COPY
+  #define ZERO_COPY 1 // 1: acquisition blocks are placed directly into disk buffers
+#endif
+
+// acquisition queue (MQUEU audio blocks, ZERO_COPY==0) or
+// disk queue (NDBUF disk buffers of BUFFERSIZE samples, ZERO_COPY==1)
+// disk buffers are written by loop() while interrupt continues to fill queue
+// one disk buffer is always being filled, so a write stall of up to
+// (NDBUF-1)*DBUF_BYTES/rate is covered: at 192 kHz, 16 bit mono about
+// 85 ms (3.2), 299 ms (3.5) and 469 ms (3.6)
 #if defined(__MK20DX256__)
-  #define MQUEU (100/NCH) // number of buffers in aquisition queue
+  #define MQUEU_DEF (100/NCH) // number of buffers in aquisition queue
+  #define NDBUF_DEF 5
+  #define BUFFERSIZE_DEF (4*1024)
 #elif defined(__MK64FX512__)
-  #define MQUEU (200/NCH) // number of buffers in aquisition queue
+  #define MQUEU_DEF (200/NCH) // number of buffers in aquisition queue
+  #define NDBUF_DEF 8
+  #define BUFFERSIZE_DEF (8*1024)
 #elif defined(__MK66FX1M0__)
-  #define MQUEU (550/NCH) // number of buffers in aquisition queue
+  #define MQUEU_DEF (550/NCH) // number of buffers in aquisition queue
+  #define NDBUF_DEF 12
+  #define BUFFERSIZE_DEF (8*1024)
 #else
-  #define MQUEU 53 // number of buffers in aquisition queue
+  #define MQUEU_DEF 53 // number of buffers in aquisition queue
+  #define NDBUF_DEF 2
+  #define BUFFERSIZE_DEF (8*1024)
+#endif
+
+#ifndef MQUEU
+  #define MQUEU MQUEU_DEF
+#endif
+#ifndef NDBUF
+  #define NDBUF NDBUF_DEF   // number of disk buffers (ZERO_COPY only)
 #endif
-  
 
 // definitions for logging
 #define MAXBUF 200
-#define BUFFERSIZE (8*1024)
+#ifndef BUFFERSIZE
+  #define BUFFERSIZE BUFFERSIZE_DEF // samples per disk buffer (multiple of 256)
+#endif
+// bytes per disk buffer (multiple of sector size and of acquisition blocks)
+#if NBITS==16
+  #define DBUF_BYTES (BUFFERSIZE*2)
+#else
+  #define DBUF_BYTES ((BUFFERSIZE*2/(3*512))*(3*512))
+#endif
+
+#if ZERO_COPY==0 && NBITS!=16
+  #error "24 bit acquisition needs ZERO_COPY"
+#endif
+
+#ifndef DECIM
+  #define DECIM 1 // decimation factor (1, 2, 4, 8) of stored data
+#endif
+#define DECIM_TAPS (24*DECIM) // FIR length of decimation filter
+#define BLOCK_SAMPLES (AUDIO_BLOCK_SAMPLES/DECIM) // stored samples per acquisition block
+#if DECIM>1 && NBITS!=16
+  #error "decimation needs 16 bit data"
+#endif
+#define DBUF_BLOCKS (DBUF_BYTES/(SAMPLE_BYTES*NCH*BLOCK_SAMPLES)) // acquisition blocks per disk buffer
+
+#ifndef DO_TRIGGER
+  #define DO_TRIGGER 0 // 1: store only disk buffers around detected events (ZERO_COPY only)
+#endif
+#if DO_TRIGGER>0
+  #if ZERO_COPY==0
+    #error "trigger mode needs ZERO_COPY"
+  #endif
+  #define TRIG_PRE (NDBUF/2)  // disk buffers of pre-trigger history (at most NDBUF-2)
+  #define TRIG_HOLD 5.0f      // post-trigger hold time (s)
+  #define TRIG_THRESH 10.0f   // detection threshold (block energy over background)
+  #define TRIG_NAVG 1000.0f   // blocks of background average
+#endif
+
+#ifndef DO_LTSA
+  #define DO_LTSA 0 // 1: long-term spectral average alongside audio files, 2: LTSA only
+#endif
+#if DO_LTSA>0
+  #define LTSA_NFFT 1024 // FFT size (256, 1024)
+  #define LTSA_AVG 60    // averaging interval (s)
+  #define LTSA_BANDS 1   // 0: FFT bins, 1: 1/3 octave bands
+  #if DO_LTSA>1 && DO_TRIGGER>0
+    #error "LTSA only mode does not store triggered audio"
+  #endif
+#endif
+
+#ifndef DO_FLAC
+  #define DO_FLAC 0 // 1: store lossless compressed .flac files
+#endif
+#ifndef RAW_WRITE
+  #define RAW_WRITE 0 // 1: stream disk buffers with multi-block writes to contiguous file sectors (SdFs)
+#endif
+#ifndef CHECKPOINT_S
+  #define CHECKPOINT_S 10 // s between header and directory updates of open file (0: at close only)
+                          // with RAW_WRITE the directory size stays at the preallocated length
+#endif
+#ifndef WRITE_TRACE
+  #define WRITE_TRACE 0 // n>0: latencies (us) of first n writes per file to trace.txt (tools/fs_sim -t)
+#endif
+#ifndef DO_TELEM
+  #define DO_TELEM 1 // 1: binary telemetry record per second, appended to telem.bin with each file
+#endif
+#if DO_TELEM>0
+  #include "m_telem.h"
+  // ring is written at file close and hibernation only, not while recording;
+  // of longer files the oldest records are lost (flagged in the next record)
+  #if defined(__MK20DX256__)
+    #define TELEM_NREC 64    // records in RAM ring (28 bytes each)
+  #else
+    #define TELEM_NREC 512
+  #endif
+  #define TELEM_MS 1000      // record interval (ms)
+  mTelem<TELEM_NREC> telem;
+#endif
+
+#ifndef DO_CLOCK
+  #define DO_CLOCK 1 // 1: measure sample rate against RTC seconds, written to header with each file
+#endif
 
+#ifndef FILE_POOL
+  #define FILE_POOL 0 // >0: number of preallocated files in /pool, created on first start with new card
+#endif
+#if RAW_WRITE>0 && DO_FLAC>0
+  #error "raw write needs full sectors (no FLAC)"
+#endif
+
+#if DO_FLAC>0
+  #include "m_flac.h"
+  #define FLAC_BLOCK 1024 // max samples per channel and FLAC frame
+  #define FLAC_CHUNK (DBUF_BYTES/(NCH*SAMPLE_BYTES)) // frames encoded per write
+  mFlacEncoder<NCH,NBITS,FLAC_BLOCK> flac;
+  uint8_t flacBuffer[DBUF_BYTES + (FLAC_CHUNK/FLAC_BLOCK+1)*MF_OVERHEAD];
+#endif
+
+#if ZERO_COPY==0
 // adapted from audio gui
   #include "input_i2s.h"
   AudioInputI2S        acq;
 
   #include "m_queue.h"
-  mRecordQueue<MQUEU>  queue1;
+  #if NCH==1
+    mRecordQueue<MQUEU>  queue1;
+
+    AudioConnection      patchCord1(acq,SEL_LR, queue1,0);
+  #else
+    mRecordQueue<MQUEU>  queue1, queue2;
+
+    AudioConnection      patchCord1(acq,0, queue1,0);
+    AudioConnection      patchCord2(acq,1, queue2,0);
+  #endif
+  #include "m_dsp.h"
+  #if DECIM>1
+    mDecimator<DECIM,DECIM_TAPS> dec[NCH];
+  #endif
+#else
+  #include "m_queue.h"
+  mDiskQueue<NDBUF,DBUF_BYTES> queue1;
+
+  #include "m_i2s.h"
+  mInputI2S<mDiskQueue<NDBUF,DBUF_BYTES>,NCH,SEL_LR,NBITS,DECIM,DECIM_TAPS> acq;
+#endif
+
+#if DO_CLOCK>0
+  #include "m_clock.h"
+  mClock fsClock;
+#endif
 
-  AudioConnection      patchCord1(acq,SEL_LR, queue1,0);
+#if DO_LTSA>0
+  #include "m_ltsa.h"
+  mLtsa<NCH,NBITS,LTSA_NFFT> ltsa;
+#endif
+
+#if DO_TRIGGER>0
+  #include "m_trigger.h"
+  mTrigger<NCH,NBITS,BLOCK_SAMPLES> trigger;
+  int32_t trigPost; // disk buffers of post-trigger hold
+#endif
 
   #include "control_sgtl5000.h"
   AudioControlSGTL5000 audioShield;
@@ -75,25 +242,155 @@ int isf = FSI;
 #include "logger_if.h"
 #include "hibernate.h"
 
-// utility for hibernating
-const int32_t on = 60;
-const int32_t off = 60;
+// display menu
+#include "display.h"
+
+// recording schedule (rec_dur, rec_int and diel window from menu/EEPROM)
+#include "m_sched.h"
+#define START_DAY 0 // first day of recording (yyyymmdd), 0: immediately
+// additional daily windows in diel mode (start, end minute of day), {0, 0}: none
+const uint16_t dielWindows[][2] = {{0, 0}};
+
+mSchedule sched;
 
+void scheduleInit(void)
+{ uint32_t t0 = 0;
+  #if START_DAY>0
+    struct tm tx;
+    memset(&tx, 0, sizeof(tx));
+    tx.tm_year = START_DAY/10000; 
+    tx.tm_mon = (START_DAY/100)%100; 
+    tx.tm_mday = START_DAY%100;
+    t0 = tm2seconds(&tx);
+  #endif
+  sched.begin(t0, rec_dur, rec_int);
+  if(recMode==MODE_DIEL)
+  { sched.addWindow(startHour*60+startMinute, endHour*60+endMinute);
+    for(uint32_t ii=0; ii<sizeof(dielWindows)/sizeof(dielWindows[0]); ii++)
+      sched.addWindow(dielWindows[ii][0], dielWindows[ii][1]);
+  }
+}
+
+// utility for hibernating
 uint32_t record_or_sleep(void)
 {
-  uint32_t tt = RTC_TSR;
-  uint32_t dt = tt % (on+off);
-  if(dt>=on) return (on+off-dt);
-  return 0;
+  #if DO_SWEEP>0
+    return 0; // files are closed after MAXBUF buffers
+  #endif
+  return sched.sleepTime(RTC_TSR);
+}
+
+uint64_t expectedFileSize(uint32_t tt)
+{ // header, data (uncompressed) and one spare disk buffer for file opened at tt
+  uint64_t nbytes;
+  #if DO_SWEEP>0
+    nbytes = (uint64_t)MAXBUF*BUFFERSIZE*2;
+  #elif DO_TRIGGER>0
+    nbytes = (uint64_t)(TRIG_PRE+1+trigPost)*DBUF_BYTES; // minimal event
+  #else
+    uint32_t te = sched.periodEnd(tt);
+    if(te<=tt) return PRE_ALLOCATE_SIZE;
+    nbytes = (uint64_t)(te-tt)*(fsamps[isf]/DECIM)*NCH*SAMPLE_BYTES;
+  #endif
+  return 512 + nbytes + DBUF_BYTES;
+}
+
+uint64_t poolFileSize(void)
+{ // size of pool files: one full recording period
+  #if DO_SWEEP>0 || DO_TRIGGER>0
+    return expectedFileSize(RTC_TSR);
+  #else
+    return 512 + (uint64_t)rec_dur*(fsamps[isf]/DECIM)*NCH*SAMPLE_BYTES + DBUF_BYTES;
+  #endif
+}
+
+uint64_t nextFileSize(int fileOpen)
+{ // size of next file, if it can be created now, 0 otherwise
+  #if DO_SWEEP>0 || DO_TRIGGER>0
+    return expectedFileSize(RTC_TSR);
+  #else
+    if(!fileOpen) return 0; // file is opened at start of recording period
+    uint32_t tn = sched.periodEnd(RTC_TSR); // next file starts when current ends
+    if(sched.sleepTime(tn)>0) return 0; // hibernating before next file
+    return expectedFileSize(tn);
+  #endif
+}
+
+uint32_t record_period(void)
+{
+  #if DO_SWEEP>0
+    return 0;
+  #endif
+  return sched.periodStart(RTC_TSR);
 }
 
 // utility for logger
 
 #define WAV_HEADER
 
+#ifndef WAV_HEADER
+  char header[512];
+#else
+  #define WAV_TIMING (sizeof(wav_hdr.info)-48) // position of timing in info
+  #define WAV_CLOCK (WAV_TIMING-48) // position of measured sample rate
+#endif
+
+// sample index and time of audio stream (since acquisition start)
+uint32_t fileBlock0=0;  // first acquisition block of current file
+uint64_t lostBlocks=0;  // blocks lost in gaps fetched so far
+uint32_t rtcSec, rtcUs, rtcMicros; // RTC and micros() when acquisition was started
+
+void streamStart(void)
+{ uint32_t tpr, tsr;
+  do { tpr = RTC_TPR & 0x7fff; tsr = RTC_TSR; } while((RTC_TPR & 0x7fff) < tpr); // prescaler wrapped
+  rtcMicros = micros();
+  rtcSec = tsr;
+  fileBlock0 = 0; lostBlocks = 0; // sample index restarts with queue (begin)
+  rtcUs = (uint32_t)(((uint64_t)tpr*1000000) >> 15);
+}
+
+void streamEpoch(uint32_t *sec, uint32_t *us)
+{ // RTC time of first sample: arrival of first block less one block
+  int64_t tt = (int64_t)rtcSec*1000000 + rtcUs + (int32_t)(queue1.getT0()-rtcMicros)
+             - (int64_t)1000000*AUDIO_BLOCK_SAMPLES/fsamps[isf];
+  #if DECIM>1
+    // FIR group delay: stored sample k is centred (DECIM_TAPS-1)/2 input samples
+    // before the newest input of its window, input k*DECIM + DECIM-1
+    tt -= (int64_t)1000000*(DECIM_TAPS-1 - 2*(DECIM-1))/(2*fsamps[isf]);
+  #endif
+  *sec = tt/1000000; *us = tt%1000000;
+}
+
+uint64_t fileSample0(void)
+{ // index of first sample in file (at stored rate), gaps before count as samples
+  return ((uint64_t)fileBlock0 + lostBlocks)*BLOCK_SAMPLES;
+}
+
+int getGap(uint32_t *pos, uint32_t *len, uint32_t before)
+{ // fetch gap from queue and keep sample index
+  if(!queue1.getGap(pos, len, before)) return 0;
+  lostBlocks += *len;
+  return 1;
+}
+
 char * headerUpdate(void)
 {
-#ifdef WAV_HEADER
+  uint64_t s0 = fileSample0();
+  uint32_t t0s, t0u;
+  streamEpoch(&t0s, &t0u);
+  #if DO_CLOCK>0
+    fsClock.reset();
+  #endif
+#if DO_FLAC>0
+    flac.begin(fsamps[isf]/DECIM);
+    struct tm tx = seconds2tm(RTC_TSR);
+    sprintf(flac.info(), "%04d_%02d_%02d_%02d_%02d_%02d; %6d, %4d, %4d; s0 %08x%08x; t0 %u.%06u; ",
+                tx.tm_year, tx.tm_mon, tx.tm_mday, tx.tm_hour, tx.tm_min, tx.tm_sec,
+                fsamps[isf], (int)rec_dur, (int)rec_int,
+                (uint32_t)(s0>>32), (uint32_t)s0, t0s, t0u);
+    return flac.header();
+
+#elif defined(WAV_HEADER)
     sprintf(wav_hdr.rId,"RIFF");
 //    wav_hdr.rLen=44-2*4;
     wav_hdr.rLen=512-2*4;
@@ -102,11 +399,11 @@ char * headerUpdate(void)
     sprintf(wav_hdr.fId,"fmt ");
     wav_hdr.fLen=0x10;
     wav_hdr.nFormatTag=1;
-    wav_hdr.nChannels=1;
-    wav_hdr.nSamplesPerSec=audio_srate;
-    wav_hdr.nAvgBytesPerSec=audio_srate*2;
-    wav_hdr.nBlockAlign=2;
-    wav_hdr.nBitsPerSamples=16;
+    wav_hdr.nChannels=NCH;
+    wav_hdr.nSamplesPerSec=fsamps[isf]/DECIM;
+    wav_hdr.nAvgBytesPerSec=wav_hdr.nSamplesPerSec*SAMPLE_BYTES*NCH;
+    wav_hdr.nBlockAlign=SAMPLE_BYTES*NCH;
+    wav_hdr.nBitsPerSamples=NBITS;
 
     sprintf(wav_hdr.iId,"info");
     wav_hdr.iLen = 512 - 13*4;
@@ -117,17 +414,24 @@ char * headerUpdate(void)
     //
     // add more info to header
     //
-    sprintf(&wav_hdr.info[20],"%6d, %4d, %4d",fsamps[isf],on,off);
+    sprintf(&wav_hdr.info[20],"%6d, %4d, %4d",fsamps[isf],(int)rec_dur,(int)rec_int);
     sprintf(&wav_hdr.info[40],"end");
+    // statistics and gaps of previous file replaced by open marker, so that an
+    // unclosed file has no gap list (tools/wav_concat.cpp, wav_recover.cpp)
+    memset(&wav_hdr.info[64], 0, WAV_CLOCK-64);
+    sprintf(&wav_hdr.info[64],"open");
+    memset(&wav_hdr.info[WAV_CLOCK], 0, WAV_TIMING-WAV_CLOCK); // rate is measured until close
+    // first sample index and stream epoch (RTC time of sample 0)
+    sprintf(&wav_hdr.info[WAV_TIMING],"s0 %08x%08x; t0 %u.%06u",
+                (uint32_t)(s0>>32), (uint32_t)s0, t0s, t0u);
 
     sprintf(wav_hdr.dId,"data");
-    wav_hdr.dLen = MAXBUF * BUFFERSIZE * 2;
+    wav_hdr.dLen = 0; // set by checkpoints and at close
     wav_hdr.rLen += wav_hdr.dLen;
   
    return (char *)&wav_hdr;
 
 #else
-  static char header[512];
   sprintf(&header[0], "WMXZ");
   
   struct tm tx = seconds2tm(RTC_TSR);
@@ -135,14 +439,127 @@ char * headerUpdate(void)
   //
   // add more info to header
   //
-  *(uint32_t*) &header[24] = fsamps[isf];
-  *(int32_t*) &header[28] = on;
-  *(int32_t*) &header[32] = off;
+  *(uint32_t*) &header[24] = fsamps[isf]/DECIM;
+  *(int32_t*) &header[28] = rec_dur;
+  *(int32_t*) &header[32] = rec_int;
+  memset(&header[36], 0, 488-36); // size, statistics and gaps, set at close
+  memset(&header[488], 0, 8); // measured rate, set at close
+  memcpy(&header[496], &s0, 8); // first sample index (unaligned)
+  *(uint32_t*) &header[504] = t0s; // stream epoch
+  *(uint32_t*) &header[508] = t0u;
+  return header;
+
+#endif
+}
+
+char * statText(char *txt, char *end, uint32_t nblk)
+{ // queue statistics and gaps as text, up to end (exclusive)
+  // gaps that do not fit completely are only counted
+  char *lim = end - 12; // room for "; <ngap>"
+  char gtxt[24];
+  uint32_t pos, len, ngap=0;
+  int nc = snprintf(txt, lim-txt, "drop %d, run %d, queue %d; gaps",
+              queue1.getDropped(), queue1.getMaxRun(), queue1.getMaxUsage());
+  txt += (nc < lim-txt) ? nc : lim-txt-1;
+  while(getGap(&pos, &len, fileBlock0+nblk))
+  { nc = snprintf(gtxt, sizeof(gtxt), " %d:%d", (pos-fileBlock0)*BLOCK_SAMPLES, len*BLOCK_SAMPLES);
+    if(nc < lim-txt) { memcpy(txt, gtxt, nc+1); txt += nc; }
+    ngap++;
+  }
+  nc = snprintf(txt, end-txt, "; %d", ngap);
+  return txt + ((nc < end-txt) ? nc : end-txt-1);
+}
+
+#if DO_SWEEP>0
+  uint16_t sweepQmax=0;    // queue statistics of all files at current rate,
+  uint32_t sweepDropped=0; // the per file counters are reset at close
+#endif
+void statsDone(void)
+{ // queue statistics are per file
+  #if DO_SWEEP>0
+    if(queue1.getMaxUsage()>sweepQmax) sweepQmax=queue1.getMaxUsage();
+    sweepDropped+=queue1.getDropped();
+  #endif
+  queue1.resetStats();
+}
+
+char * headerClose(uint32_t nbytes)
+{ // called before file is closed
+  // add statistics of acquisition queue and gaps (in samples from file start)
+#if DO_FLAC>0
+    uint32_t nblk = flac.getSamples()/BLOCK_SAMPLES;
+    char *txt = flac.info();
+    txt += strlen(txt);
+    #if DO_CLOCK>0
+      fsClock.poll();
+      txt += fsClock.sprint(txt);
+      txt += sprintf(txt, "; ");
+    #endif
+    statText(txt, flac.info()+MF_INFO, nblk);
+
+    statsDone();
+    fileBlock0 += nblk;
+    return flac.header();
+
+#elif defined(WAV_HEADER)
+    uint32_t nblk = nbytes/(SAMPLE_BYTES*NCH*BLOCK_SAMPLES);
+    wav_hdr.dLen = nbytes;
+    wav_hdr.rLen = 512 - 2*4 + wav_hdr.dLen;
+
+    #if DO_CLOCK>0
+      fsClock.poll();
+      fsClock.sprint(&wav_hdr.info[WAV_CLOCK]);
+    #endif
+    statText(&wav_hdr.info[64], &wav_hdr.info[WAV_CLOCK], nblk);
+
+    statsDone();
+    fileBlock0 += nblk;
+    return (char *)&wav_hdr;
+
+#else
+  uint32_t nblk = nbytes/(SAMPLE_BYTES*NCH*BLOCK_SAMPLES);
+  uint32_t pos, len, ngap=0;
+  *(uint32_t*) &header[36] = nbytes;
+  *(uint32_t*) &header[40] = queue1.getDropped();
+  *(uint32_t*) &header[44] = queue1.getMaxRun();
+  *(uint32_t*) &header[48] = queue1.getMaxUsage();
+  #if DO_CLOCK>0
+    fsClock.poll();
+    double fsm = fsClock.rate(); // measured sample rate
+    memcpy(&header[488], &fsm, 8);
+  #endif
+  uint32_t *gaps = (uint32_t*) &header[56];
+  while(getGap(&pos, &len, fileBlock0+nblk))
+  { if(ngap<(488-56)/8)
+    { gaps[2*ngap] = (pos-fileBlock0)*BLOCK_SAMPLES; 
+      gaps[2*ngap+1] = len*BLOCK_SAMPLES;
+    }
+    ngap++;
+  }
+  *(uint32_t*) &header[52] = ngap;
+
+  statsDone();
+  fileBlock0 += nblk;
   return header;
 
 #endif
 }
 
+char * headerCheck(uint32_t nbytes)
+{ // called periodically while file is open, so that file is valid after power loss
+#if DO_FLAC>0
+    return flac.header(); // samples encoded so far
+#elif defined(WAV_HEADER)
+    wav_hdr.dLen = nbytes;
+    wav_hdr.rLen = 512 - 2*4 + wav_hdr.dLen;
+    sprintf(&wav_hdr.info[64], "ckpt"); // replaced by statistics at close
+    return (char *)&wav_hdr;
+#else
+  *(uint32_t*) &header[36] = nbytes;
+  return header;
+#endif
+}
+
 // utility for acquisition
 const int hydroPowPin = 2;
 void acqInit(void)
@@ -185,43 +602,257 @@ float readVoltage(){
 
 float readTemp(){
    float  voltage = 0;
+  // internal sensor: VTEMP25 (V) at 25 C and slope (V/C) from data sheet
   #if defined(__MK20DX256__)
      const int vTemp = 38;
+     const float v25 = 0.716f, slope = 0.00162f;
   #elif defined(__MK64FX512__) || defined(__MK66FX1M0__)
      const int vTemp = 70;
+     const float v25 = 0.719f, slope = 0.001715f;
   #endif
    for(int n = 0; n<8; n++){
     voltage += (float) analogRead(vTemp) / ADC_SCALE;
    }
-   voltage = voltage*3.3f/ADC_SCALE; // V
-   voltage = 25.0f-((voltage-0.716f)*0.588f); // deg C
+   voltage = voltage*3.3f/8.0f; // V
+   voltage = 25.0f-(voltage-v25)/slope; // deg C
 
    return voltage;
 }
 
-void logAcq(void)
+void appendLog(const char *text)
+{
+  uSD.pause();
+  #if USE_FS == RamFS
+    Serial.print(text); // no card
+  #elif USE_FS == uSDFS
+    FIL file; UINT nw; TCHAR wname[20];
+    char2tchar((char *)"/acqLog.txt", 20, wname);
+    if (f_open(&file, wname, FA_WRITE | FA_OPEN_APPEND)) {Serial.println("LOG"); return;}
+    f_write(&file, text, strlen(text), &nw);
+    f_close(&file);
+  #else
+    #if USE_FS == SdFS
+      FsFile file;
+    #elif  USE_FS == SDo
+      File file;
+    #endif
+
+    if (!file.open("/acqLog.txt", O_CREAT | O_WRITE | O_APPEND)) {Serial.println("LOG"); return;}
+    file.write(text, strlen(text));
+    file.close();
+  #endif
+}
+
+void appendFile(const char *name, const void *head, uint32_t nh, const void *data, uint32_t nd)
+{ // append data to binary file, starting with head if file is new
+  uSD.pause();
+  #if USE_FS == RamFS
+    // no card: discarded
+  #elif USE_FS == uSDFS
+    FIL file; UINT nw; TCHAR wname[20];
+    char2tchar((char *)name, 20, wname);
+    if (f_open(&file, wname, FA_WRITE | FA_OPEN_APPEND)) {Serial.println(name); return;}
+    if(f_size(&file)==0) f_write(&file, head, nh, &nw);
+    f_write(&file, data, nd, &nw);
+    f_close(&file);
+  #else
+    #if USE_FS == SdFS
+      FsFile file;
+    #elif  USE_FS == SDo
+      File file;
+    #endif
+
+    if (!file.open(name, O_CREAT | O_WRITE | O_APPEND)) {Serial.println(name); return;}
+    #if USE_FS == SdFS
+      bool empty = (file.fileSize()==0);
+    #elif  USE_FS == SDo
+      bool empty = (file.size()==0);
+    #endif
+    if(empty) file.write(head, nh);
+    file.write(data, nd);
+    file.close();
+  #endif
+}
+
+#if DO_LTSA>0
+void appendLtsa(void)
 {
-  #if USE_FS == SdFS
-    FsFile file;
-  #elif  USE_FS == SDo
-    File file;
+  uint32_t nh, nd;
+  const void *head = ltsa.header(&nh);
+  const void *data = ltsa.record(RTC_TSR, &nd);
+  appendFile("/ltsa.bin", head, nh, data, nd);
+}
+#endif
+
+#if DO_TELEM>0
+void telemSample(uint32_t loops)
+{ // cheap enough to run once per interval in production
+  mTelemRecord *r = telem.next();
+  r->time = RTC_TSR;
+  r->loops = loops;
+  r->blocks = queue1.getBlocks();
+  r->dropped = queue1.getDropped();
+  r->nbuf = uSD.getNbuf();
+  r->queue = queue1.getMaxUsage();
+  #if ZERO_COPY==0
+    r->audioMem = AudioMemoryUsageMax();
+    AudioMemoryUsageMaxReset();
+  #else
+    r->audioMem = 0;
   #endif
+  r->vin = (uint16_t)(readVoltage()*1000.0f);
+  r->temp = (int16_t)(readTemp()*100.0f);
+}
 
-  if (!file.open("acqLog.txt", O_CREAT | O_WRITE | O_APPEND)) {Serial.println("LOG"); while(1) asm volatile("wfi");}
+void appendTelem(void)
+{
+  static const uint32_t head[2] = {0x314d4c54, sizeof(mTelemRecord)}; // "TLM1"
+  mTelemRecord *recs;
+  int nr;
+  while((nr = telem.read(&recs)) > 0)
+  { appendFile("/telem.bin", head, sizeof(head), recs, nr*sizeof(mTelemRecord));
+    telem.release(nr);
+  }
+}
+#endif
 
+void logAcq(void)
+{
+  char text[80];
   struct tm tx = seconds2tm(RTC_TSR);
-  file.printf("%04d%02d%02d_%02d%02d%02d", 
-                tx.tm_year,tx.tm_mon,tx.tm_mday,tx.tm_hour,tx.tm_min,tx.tm_sec);
+  sprintf(text, "%04d%02d%02d_%02d%02d%02d: VIN %f; Temp %f \r\n",
+                tx.tm_year,tx.tm_mon,tx.tm_mday,tx.tm_hour,tx.tm_min,tx.tm_sec,
+                readVoltage(),readTemp());
+  appendLog(text);
+}
 
-  file.printf(": VIN %f; Temp %f \r\n",readVoltage(),readTemp());
-  
-  file.close();
+#if DO_SWEEP>0
+// throughput benchmark: report sustained rate and queue statistics of last file
+// and switch to next sampling frequency
+uint32_t sweepBlocks=0;
+uint32_t sweepT0=0;   // acquisition start at current frequency
+int16_t sweepNext=0;  // acquisition stopped, to be restarted by loop
+#if ZERO_COPY==0
+  #define SWEEP_QCAP MQUEU      // audio blocks per channel
+#else
+  #define SWEEP_QCAP (NDBUF-1)  // disk buffers, one is always being filled
+#endif
+void acqStart(void);
+
+void sweepReport(void)
+{
+  uint32_t dt = millis()-sweepT0;
+  if(dt==0) dt=1;
+  statsDone(); // blocks since last file
+  Serial.printf("fs %6d: %8d samples/s; queue max %4d of %4d; dropped %d",
+       fsamps[isf], (uint32_t)((uint64_t)sweepBlocks*128*1000/dt),
+       sweepQmax, SWEEP_QCAP, sweepDropped);
+  Serial.println();
+
+  // no blocks while I2S and codec change rate, the queue is restarted
+  // by loop once the buffer being written is released
+  #if DO_CLOCK>0
+    fsClock.end();
+  #endif
+  queue1.end();
+  #if ZERO_COPY==0 && NCH==2
+    queue2.end();
+  #endif
+  isf++; if(isf>MAX_FSI) isf=0;
+  audio_srate = fsamps[isf];
+  I2S_modification(fsamps[isf],32);
+  SGTL5000_modification(isf);
+  sweepNext=1;
 }
 
-// display menu
-#include "display.h"
+void sweepStart(void)
+{
+  queue1.resetStats();
+  sweepQmax=0;
+  sweepDropped=0;
+  sweepBlocks=0;
+  sweepNext=0;
+  acqStart(); // sets sweepT0
+}
+#endif
+
+#if DO_BENCH>0
+// cycles of processing kernels per frame and CPU load at 96 kHz
+#include "m_dsp.h"
+void benchPrint(const char *name, uint32_t cycles, int nframes)
+{ float cpf = (float)cycles/nframes;
+  Serial.printf("%-16s %6d cycles per %d frames; %6.2f cycles/frame; %5.2f%% CPU at 96 kHz",
+          name, cycles, nframes, cpf, 100.0f*cpf*96000.0f/F_CPU);
+  Serial.println();
+}
+
+#define BENCH(name, nframes, x) \
+  { uint32_t t0_=ARM_DWT_CYCCNT; for(int ii=0; ii<NREP; ii++) { x; } \
+    benchPrint(name, (ARM_DWT_CYCCNT-t0_)/NREP, nframes); }
+
+void benchKernels(void)
+{ const int NREP=100;
+  static uint32_t src[256], dst[256];
+  for(int ii=0; ii<256; ii++) src[ii] = ii*0x00010001*1234;
+
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+
+  BENCH("copy32", 128, copy32(dst, src, 64));
+  BENCH("deinterleave1", 128, deinterleave1(dst, src, 128, SEL_LR));
+  BENCH("copy32 stereo", 128, copy32(dst, src, 128));
+  BENCH("interleave2", 128, interleave2(dst, src, src+64, 128));
+  BENCH("pack24", 128, pack24(dst, src+SEL_LR, 128, 2));
+  BENCH("pack24 stereo", 128, pack24(dst, src, 256, 1));
+
+  #if DECIM>1
+    // decimation load per channel at all sampling frequencies
+    static mDecimator<DECIM,DECIM_TAPS> dtest;
+    uint32_t t0=ARM_DWT_CYCCNT;
+    for(int ii=0; ii<NREP; ii++) dtest.process((int16_t *)dst, 1, (int16_t *)src, 2, 128);
+    float cps = (float)(ARM_DWT_CYCCNT-t0)/(NREP*128);
+    for(int ii=0; ii<=MAX_FSI; ii++)
+    { Serial.printf("decimate %d, %3d taps: %6.2f cycles/sample; %5.2f%% CPU at %6d Hz",
+          DECIM, DECIM_TAPS, cps, 100.0f*cps*NCH*fsamps[ii]/F_CPU, fsamps[ii]);
+      Serial.println();
+    }
+  #endif
+
+  #if DO_FLAC>0
+    // test signal: triangle with noise of about 8 bit
+    static uint8_t sig[FLAC_BLOCK*NCH*SAMPLE_BYTES];
+    uint32_t rnd=1;
+    for(int ii=0; ii<FLAC_BLOCK*NCH; ii++)
+    { rnd = rnd*1664525+1013904223;
+      int32_t v = 64*(((ii/NCH)&255)-128) + ((int32_t)(rnd>>24)-128);
+      if(NBITS==24) v <<= 8;
+      for(int jj=0; jj<SAMPLE_BYTES; jj++) sig[ii*SAMPLE_BYTES+jj] = v>>(8*jj);
+    }
+    uint32_t nc=0;
+    BENCH("flac", FLAC_BLOCK, nc=flac.encode(flacBuffer, sig, FLAC_BLOCK));
+    Serial.printf("flac %d of %d bytes", nc, sizeof(sig));
+    Serial.println();
+  #endif
+}
+#endif
 
 //__________________________General Arduino Routines_____________________________________
+void acqStart(void)
+{ // start (or restart) filling the queue
+  streamStart();
+  #if ZERO_COPY==0 && NCH==2
+    queue2.follow(&queue1); // channels drop together
+    queue2.begin();         // before queue1, so it cannot start a block late
+  #endif
+  queue1.begin();
+  #if DO_CLOCK>0
+    fsClock.begin(&queue1, I2S_rate(fsamps[isf],32)/DECIM, BLOCK_SAMPLES);
+  #endif
+  #if DO_SWEEP>0
+    sweepT0=millis();
+  #endif
+}
+
 extern "C" void setup() {
   // put your setup code here, to run once:
 
@@ -230,7 +861,12 @@ extern "C" void setup() {
   #endif
 
 
-  if(menuSetup()) {  menuLoop(); } menuExit();  
+  if(menuSetup()) {  menuLoop(); } else { loadSettings(); } menuExit();  
+  scheduleInit();
+
+  #if DO_BENCH>0
+    benchKernels();
+  #endif
 
   uint32_t nsec = record_or_sleep();
   if(nsec>0)
@@ -248,13 +884,20 @@ extern "C" void setup() {
 
   acqInit();
   
-  AudioMemory (MQUEU+6);
+  #if ZERO_COPY==0
+    AudioMemory (NCH*MQUEU+6);
+  #else
+    acq.begin(&queue1, fsamps[isf]); // provides also MCLK for audio shield
+  #endif
   audioShield.enable();
   audioShield.inputSelect(AUDIO_INPUT_LINEIN);  //AUDIO_INPUT_LINEIN or AUDIO_INPUT_MIC
    //
   I2S_modification(fsamps[isf],32);
   delay(1);
   SGTL5000_modification(isf); // must be called after I2S initialization stabilized
+  #if NBITS==24
+    SGTL5000_dataLength(24);
+  #endif
   
   #if DO_DEBUG>0
     Serial.println("start");
@@ -263,84 +906,239 @@ extern "C" void setup() {
   #endif
 
   uSD.init();
+  #if DO_PROF>0
+    prof.begin();
+  #endif
+  #if DO_BENCH>0
+    // same disk buffer size for all backends (select with USE_FS)
+    static uint8_t benchBuffer[DBUF_BYTES];
+    for(uint32_t ii=0; ii<DBUF_BYTES; ii++) benchBuffer[ii] = ii;
+    uSD.bench(benchBuffer, DBUF_BYTES, (32<<20)/DBUF_BYTES);
+  #endif
   logAcq();
   uSD.chDir(); 
 
-  queue1.begin();
+  #if DO_LTSA>0
+    ltsa.begin(fsamps[isf]/DECIM, LTSA_AVG, LTSA_BANDS);
+  #endif
+  #if DO_TRIGGER>0
+    trigger.begin(TRIG_THRESH, TRIG_NAVG);
+    trigPost = (int32_t)(TRIG_HOLD*fsamps[isf]/DECIM/(DBUF_BYTES/(NCH*SAMPLE_BYTES))) + 1;
+  #endif
+
+  acqStart();
+}
+
+int16_t state=0; // 0: open new file, -1: last file
+void sleepIfDue(void);
+void profReport(void);
+
+void storeBuffer(uint8_t *buffer, uint32_t nbytes)
+{
+  #if DO_LTSA>0 && DO_TRIGGER==0 // triggered data are analysed when checked
+    bool ltsaDone;
+    MP_TIME(MP_DSP, ltsaDone = ltsa.process(buffer, nbytes/(NCH*SAMPLE_BYTES)));
+    if(ltsaDone) appendLtsa();
+  #endif
+  #if DO_LTSA>1
+    sleepIfDue(); // no audio files
+    return;
+  #endif
+
+  // write to disk ( this handles also opening of files)
+  if(state>=0)
+    MP_TIME(MP_WRITE, state=uSD.write(buffer,nbytes)); // this is blocking
+
+  if(state==0)
+  {
+    #if DO_PROF>0
+      profReport();
+    #endif
+    #if DO_TELEM>0
+      appendTelem();
+    #endif
+    #if DO_SWEEP>0
+      sweepReport();
+    #endif
+    sleepIfDue();
+  }
+}
+
+#if DO_PROF>0
+void profReport(void)
+{ // CPU profile of last file
+  static char text[512];
+  int nc = sprintf(text, "profile %d Hz: ", fsamps[isf]);
+  prof.sprint(text+nc);
+  appendLog(text);
+  #if DO_DEBUG>0
+    Serial.print(text);
+  #endif
+  prof.reset();
+}
+#endif
+
+void sleepIfDue(void)
+{
+    uint32_t nsec = record_or_sleep();
+    if(nsec>0) 
+    {
+      #if DO_TELEM>0
+        appendTelem();
+      #endif
+      #if DO_CLOCK>0
+        fsClock.end();
+      #endif
+      queue1.end();
+      #if ZERO_COPY==0 && NCH==2
+        queue2.end();
+      #endif
+      SGTL5000_disable();
+      Wire.end();
+      I2S_stopClocks();
+      acqExit();
+      delay(10);
+      uSD.exit();
+      setWakeupCallandSleep(nsec);      
+    }
 }
 
 void loop() {
   // put your main code here, to run repeatedly:
-  static int16_t state=0; // 0: open new file, -1: last file
+  #if DO_CLOCK>0
+    fsClock.poll();
+  #endif
 
-  if(queue1.available())
+#if ZERO_COPY==0
+  audio_block_t * volatile *blocks;
+  int nb = queue1.readBlocks(&blocks); // get all contiguous blocks from queue
+  #if NCH==2
+    audio_block_t * volatile *blocks2;
+    int nb2 = queue2.readBlocks(&blocks2); // same as nb, queues run in lockstep
+    if(nb2<nb) nb=nb2;
+  #endif
+  if(nb>0)
   {  // have data on queue
-    if(state==0)
-    { // generate header before file is opened
-       uint32_t *header=(uint32_t *) headerUpdate();
-       uint32_t *ptr=(uint32_t *) outptr;
-       // copy to disk buffer
-       for(int ii=0;ii<128;ii++) ptr[ii] = header[ii];
-       outptr+=256; //(512 bytes)
-       state=1;
-    }
-    // fetch data from queue
-    int32_t * data = (int32_t *)queue1.readBuffer(); // cast to int32 to speed-up following copy
-    //
-    // copy to disk buffer
-    uint32_t *ptr=(uint32_t *) outptr;
-    for(int ii=0;ii<64;ii++) ptr[ii] = data[ii];
-    queue1.freeBuffer(); 
+    // take only as many blocks as fit into disk buffer
+    int nfree = (diskBuffer+BUFFERSIZE-outptr)/(NCH*BLOCK_SAMPLES);
+    if(nb>nfree) nb=nfree;
     //
-    // advance buffer pointer
-    outptr+=128; // (128 shorts)
-    //
-    // if necessary reset buffer pointer and write to disk
-    // buffersize should be always a multiple of 512 bytes
-    if(outptr == (diskBuffer+BUFFERSIZE))
-    {
-      outptr = diskBuffer;
- 
-      // write to disk ( this handles also opening of files)
-      if(state>=0)
-        state=uSD.write(diskBuffer,BUFFERSIZE); // this is blocking
-
-      if(state==0)
-      {
-        uint32_t nsec = record_or_sleep();
-        if(nsec>0) 
-        { queue1.end();
-          SGTL5000_disable();
-          Wire.end();
-          I2S_stopClocks();
-          acqExit();
-          delay(10);
-          uSD.exit();
-          setWakeupCallandSleep(nsec);      
-        }
-      }
+    // copy to disk buffer (cast to uint32 to speed-up copy)
+    MP_SCOPE(MP_COPY);
+    for(int jj=0;jj<nb;jj++)
+    { 
+      #if DECIM>1
+        dec[0].process(outptr, NCH, blocks[jj]->data, 1, 128);
+        #if NCH==2
+          dec[1].process(outptr+1, NCH, blocks2[jj]->data, 1, 128);
+        #endif
+      #elif NCH==1
+        copy32((uint32_t *)outptr, (uint32_t *)blocks[jj]->data, 64);
+      #else
+        interleave2((uint32_t *)outptr, (uint32_t *)blocks[jj]->data, (uint32_t *)blocks2[jj]->data, 128);
+      #endif
+      //
+      // advance buffer pointer
+      outptr+=NCH*BLOCK_SAMPLES; // (BLOCK_SAMPLES shorts per channel)
     }
   }
-  else
-  {  // queue is empty
-    // do nothing
+  // release blocks (also resets batch if nothing was used)
+  queue1.freeBlocks(nb); 
+  #if NCH==2
+    queue2.freeBlocks(nb);
+  #endif
+  #if DO_SWEEP>0
+    sweepBlocks+=nb;
+  #endif
+  //
+  // if necessary reset buffer pointer and write to disk
+  // buffersize should be always a multiple of 512 bytes
+  if(outptr == (diskBuffer+BUFFERSIZE))
+  {
+    outptr = diskBuffer;
+    storeBuffer((uint8_t *)diskBuffer,BUFFERSIZE*2);
   }
+#elif DO_TRIGGER>0
+  // full disk buffers stay in queue as pre-trigger history until
+  // they are written (event) or discarded (oldest beyond TRIG_PRE)
+  static int32_t ncheck=0; // pending buffers already checked for events
+  static int32_t nwrite=0; // pending (and future) buffers to be written
+  int nav = queue1.available();
+  for( ; ncheck<nav; ncheck++)
+  { void *buffer = queue1.peekBuffer(ncheck);
+    bool event;
+    MP_TIME(MP_DSP, event = trigger.detect(buffer, DBUF_BYTES/(NCH*SAMPLE_BYTES)));
+    if(event) nwrite = ncheck+1+trigPost;
+    #if DO_LTSA>0
+      bool ltsaDone;
+      MP_TIME(MP_DSP, ltsaDone = ltsa.process(buffer, DBUF_BYTES/(NCH*SAMPLE_BYTES)));
+      if(ltsaDone) appendLtsa();
+    #endif
+  }
+
+  if(nwrite>0)
+  { void *buffer;
+    int nbuf = queue1.readBuffers(&buffer);
+    if(nbuf>ncheck) nbuf=ncheck;
+    if(nbuf>nwrite) nbuf=nwrite;
+    if(nbuf>0)
+    { if(nbuf==nwrite) uSD.setClosing(); // end of event, one file per event
+      storeBuffer((uint8_t *)buffer,nbuf*DBUF_BYTES);
+      queue1.freeBuffers(nbuf);
+      ncheck -= nbuf;
+      nwrite -= nbuf;
+      #if DO_SWEEP>0
+        sweepBlocks+=nbuf*DBUF_BLOCKS;
+        if(sweepNext) ncheck=0; // queue restarts empty at next rate
+      #endif
+    }
+  }
+  else if(ncheck>TRIG_PRE)
+  { // discard oldest buffers, skip them (and their gaps) in file accounting
+    int nd = ncheck-TRIG_PRE;
+    queue1.freeBuffers(nd);
+    ncheck -= nd;
+    #if DO_SWEEP>0
+      sweepBlocks+=nd*DBUF_BLOCKS; // acquired, not written
+    #endif
+    fileBlock0 += nd*DBUF_BLOCKS;
+    uint32_t pos, len;
+    while(getGap(&pos, &len, fileBlock0)) ;
+    //
+    if(state==0) sleepIfDue();
+  }
+#else
+  void *buffer;
+  int nbuf = queue1.readBuffers(&buffer); // get all contiguous full disk buffers
+  if(nbuf>0)
+  { // write them without copy in a single call
+    #if DO_SWEEP>0
+      sweepBlocks+=nbuf*DBUF_BLOCKS;
+    #endif
+    storeBuffer((uint8_t *)buffer,nbuf*DBUF_BYTES);
+    queue1.freeBuffers(nbuf);
+  }
+#endif
+  #if DO_SWEEP>0
+    if(sweepNext) sweepStart(); // after the written buffers are released
+  #endif
 
-   #if DO_DEBUG>0
+  #if DO_TELEM>0
     // some statistics on progress
     static uint32_t loopCount=0;
     static uint32_t t0=0;
     loopCount++;
-    if(millis()>t0+1000)
-    {  Serial.printf("loop: %5d %4d; %4d",
-             loopCount, uSD.getNbuf(),
-             AudioMemoryUsageMax());
-       Serial.println();
-       AudioMemoryUsageMaxReset();
-       t0=millis();
-       loopCount=0;
+    if(millis()-t0>=TELEM_MS)
+    { telemSample(loopCount);
+      t0=millis();
+      loopCount=0;
     }
   #endif
   //
-  asm volatile ("wfi"); // to save some power switch off idle cpu
+  // to save some power switch off idle cpu, but only if there is no backlog
+  #if DO_TRIGGER>0
+    if(queue1.available()<=TRIG_PRE) { MP_TIME(MP_WRITE, uSD.idle()); MP_WFI(); } // next file: write stage
+  #else
+    if(!queue1.available()) { MP_TIME(MP_WRITE, uSD.idle()); MP_WFI(); } // next file: write stage
+  #endif
 }
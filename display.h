@@ -126,12 +126,10 @@ boolean settingsChanged = 0;
 
 byte startHour, startMinute, endHour, endMinute; //used in Diel mode
 
-void menuLoop(){
-  boolean startRec = 0, startUp, startDown;
+void loadSettings(void)
+{
   readEEPROM();
 
-  autoStartTime = getRTC();
-    
   // make sure settings valid (if EEPROM corrupted or not set yet)
   if (rec_dur < 0 | rec_dur>100000) rec_dur = 60;
   if (rec_int<0 | rec_int>100000) rec_int = 60;
@@ -141,6 +139,13 @@ void menuLoop(){
   if (endMinute<0 | endMinute>59) endMinute = 0;
   if (recMode<0 | recMode>1) recMode = 0;
   if (isf<0 | isf>MAX_FSI) isf = FSI;
+}
+
+void menuLoop(){
+  boolean startRec = 0, startUp, startDown;
+  loadSettings();
+
+  autoStartTime = getRTC();
     
   while(startRec==0){
     static int curSetting = noSet;
@@ -153,8 +158,8 @@ void menuLoop(){
       while(digitalRead(SELECT)==0){ // wait until let go of button
         delay(10);
       }
-      if(recMode==MODE_NORMAL & (curSetting>8) & (curSetting<14)) curSetting = 14;
-      if(recMode==MODE_NORMAL & (curSetting>14)) curSetting = 0;
+      if(recMode==MODE_NORMAL & (curSetting>setMode) & (curSetting<setFsamp)) curSetting = setFsamp;
+      if(curSetting>setFsamp) curSetting = noSet;
    }
 
     cDisplay();
@@ -238,7 +243,7 @@ void menuLoop(){
         oldMinute = tx.tm_min;
         newMinute = updateVal(oldMinute, 0, 59);
         if(oldMinute!=newMinute) {
-          tx.tm_hour=newMinute;
+          tx.tm_min=newMinute;
           setRTC(tm2seconds (&tx));
         }
         display.printf("Minute:%d\r\n",newMinute);
@@ -248,11 +253,36 @@ void menuLoop(){
         oldSecond = tx.tm_sec;
         newSecond = updateVal(oldSecond, 0, 59);
         if(oldSecond!=newSecond) {
-          tx.tm_hour=newSecond;
+          tx.tm_sec=newSecond;
           setRTC(tm2seconds (&tx));
         }
         display.printf("Second:%d\r\n",newSecond);
         break;
+      case setMode:
+        recMode = updateVal(recMode, MODE_NORMAL, MODE_DIEL);
+        display.printf("Mode:%s\r\n", (recMode==MODE_DIEL) ? "Diel" : "Normal");
+        break;
+
+      case setStartHour:
+        startHour = updateVal(startHour, 0, 23);
+        display.printf("Start:%02d:%02d\r\n",startHour,startMinute);
+        break;
+
+      case setStartMinute:
+        startMinute = updateVal(startMinute, 0, 59);
+        display.printf("Start:%02d:%02d\r\n",startHour,startMinute);
+        break;
+
+      case setEndHour:
+        endHour = updateVal(endHour, 0, 23);
+        display.printf("End:%02d:%02d\r\n",endHour,endMinute);
+        break;
+
+      case setEndMinute:
+        endMinute = updateVal(endMinute, 0, 59);
+        display.printf("End:%02d:%02d\r\n",endHour,endMinute);
+        break;
+
       case setFsamp:
         isf = updateVal(isf, 0, MAX_FSI);
         display.printf("SF: %.1f\r\n",fsamps[isf]/1000.0f);
@@ -53,6 +53,16 @@ void I2S_dividers(uint32_t *iscl, uint32_t fsamp, uint32_t nbits)
     iscl[2] = (int) (i3-1); 
 } 
  
+// sampling rate of the dividers for fsamp
+double I2S_rate(uint32_t fsamp, uint32_t nbits)
+{ uint32_t iscl[3];
+  iscl[2]=1;
+  I2S_dividers(iscl, fsamp, nbits);
+  int fcpu=F_CPU;
+  if((F_CPU==48000000) || (F_CPU==24000000)) fcpu=96000000;
+  return (fcpu * (iscl[0]+1.0)) / (iscl[1]+1.0) / 2.0 / (iscl[2]+1.0) / (2.0*nbits);
+}
+
 void I2S_modification(uint32_t fsamp, uint16_t nbits) 
 { uint32_t iscl[3]; 
 
@@ -151,6 +161,12 @@ void SGTL5000_modification(uint32_t fs_mode)
   chipWrite(CHIP_CLK_CTRL, (sgtl_mode<<2));  // 256*Fs| sgtl_mode = 0:32 kHz; 1:44.1 kHz; 2:48 kHz; 3:96 kHz
 }
 
+void SGTL5000_dataLength(int nbits)
+{ // DLEN = 0:32 bit; 1:24 bit; 2:20 bit; 3:16 bit
+  int dlen = (nbits==24)? 1 : (nbits==20)? 2 : (nbits==32) ? 0 : 3;
+  chipModify(CHIP_I2S_CTRL, (dlen<<4), (3<<4));
+}
+
 void SGTL5000_disable(void)
 {
   chipWrite(CHIP_ANA_POWER, 0); 
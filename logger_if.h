@@ -78,6 +78,13 @@ HdrStruct wav_hdr;
 // which needs to be installed as local library 
 //
 uint32_t record_or_sleep(void);
+uint32_t record_period(void);
+uint64_t expectedFileSize(uint32_t tt);
+uint64_t nextFileSize(int fileOpen);
+uint64_t poolFileSize(void);
+char * headerUpdate(void);
+char * headerClose(uint32_t nbytes);
+char * headerCheck(uint32_t nbytes);
 
 #ifndef MAXFILE
   #define MAXFILE 100
@@ -89,11 +96,18 @@ uint32_t record_or_sleep(void);
 #ifndef BUFFERSIZE
   #define BUFFERSIZE (8*1024)
 #endif
-int16_t diskBuffer[BUFFERSIZE];
-int16_t *outptr = diskBuffer;
+#if ZERO_COPY==0
+  int16_t diskBuffer[BUFFERSIZE];
+  int16_t *outptr = diskBuffer;
+#endif
 
 #include "mfs.h"
+#include "m_stats.h"
+void appendLog(const char *text);
+void appendFile(const char *name, const void *head, uint32_t nh, const void *data, uint32_t nd);
 
+// FS: storage backend policy with the c_mFS interface (see mfs.h, mfs_host.h)
+template <class FS>
 class c_uSD
 {
   public:
@@ -102,21 +116,43 @@ class c_uSD
 
     void chDir(void);
     
-    int16_t write(int16_t * data, int32_t ndat);
+    int16_t write(uint8_t * data, uint32_t ndat);
     uint16_t getNbuf(void) {return nbuf;}
     void setClosing(void) {closing=1;}
+    void idle(void); // prepare next file while no data are pending
+    void pause(void) { mFS.pause(); } // before card access outside c_uSD (logs, LTSA, telemetry)
 
     void exit(void);
+
+    // sustained write test of file system backend with nbuf buffers of nbytes
+    void bench(uint8_t *buffer, uint32_t nbytes, uint32_t nbuf);
+    FS &backend(void) { return mFS; } // e.g. trace setup in host tools
     
   private:
     int16_t state; // 0 initialized; 1 file open; 2 data written; 3 to be closed
     int16_t nbuf;
     int16_t closing;
+    uint32_t nbytes; // data bytes in file
+    uint32_t period; // recording period of file
+    uint32_t tCheck; // time of next checkpoint
+    int16_t next; // next file: 0 to be created; 1 created; -1 not possible now
+    char *filename;
 
-    c_mFS mFS;
+    FS mFS;
+
+    // latency of file system operations (us)
+    mHist tOpen, tAlloc, tWrite, tHeader, tSync, tClose, tNext;
+    void logStats(void);
+    bool timedWrite(uint8_t *data, uint32_t ndat);
+    #if WRITE_TRACE>0
+      // single write latencies of current file, to be replayed by host tools
+      uint32_t trace[WRITE_TRACE];
+      uint16_t ntrace;
+      void dumpTrace(void);
+    #endif
 
 };
-c_uSD uSD;
+c_uSD<c_mFS> uSD;
 
 
 /*
@@ -140,7 +176,15 @@ char *makeFilename(void)
 
   struct tm tx = seconds2tm(RTC_TSR);
 //  sprintf(filename, "WMXZ_%04d_%02d_%02d_%02d_%02d_%02d", tx.tm_year, tx.tm_mon, tx.tm_mday, tx.tm_hour, tx.tm_min, tx.tm_sec);
-  sprintf(filename, "%02d_%02d_%02d.wav", tx.tm_hour, tx.tm_min, tx.tm_sec);
+  #if FILE_POOL>0
+    // all files in one directory
+    sprintf(filename, "%04d%02d%02d_%02d_%02d_%02d.%s", tx.tm_year, tx.tm_mon, tx.tm_mday,
+                tx.tm_hour, tx.tm_min, tx.tm_sec, DO_FLAC>0 ? "flac" : "wav");
+  #elif DO_FLAC>0
+    sprintf(filename, "%02d_%02d_%02d.flac", tx.tm_hour, tx.tm_min, tx.tm_sec);
+  #else
+    sprintf(filename, "%02d_%02d_%02d.wav", tx.tm_hour, tx.tm_min, tx.tm_sec);
+  #endif
   
   #if DO_DEBUG>0
     Serial.println(filename);
@@ -149,62 +193,263 @@ char *makeFilename(void)
 }
 
 //____________________________ FS Interface implementation______________________
-void c_uSD::init(void)
+template <class FS>
+void c_uSD<FS>::init(void)
 {
   mFS.init();
   //
   nbuf=0;
   state=0;
+  next=0;
 }
 
-void c_uSD::chDir(void)
-{ char * dirName = makeDirname();
+template <class FS>
+void c_uSD<FS>::chDir(void)
+{
+  #if FILE_POOL>0
+    // files are claimed from pool directory and renamed in place, so that
+    // neither FAT nor directories are extended while recording
+    uint64_t nalloc = poolFileSize();
+    int32_t npool = mFS.openPool((char *)"/pool", FILE_POOL, nalloc);
+    if(npool>=0)
+    { char text[80];
+      sprintf(text, "pool: %d files of %d bytes available\r\n", npool, (uint32_t)nalloc);
+      appendLog(text);
+      #if DO_DEBUG>0
+        Serial.print(text);
+      #endif
+      return;
+    }
+  #endif
+  char * dirName = makeDirname();
   mFS.mkDir(dirName);
   mFS.chDir(dirName);
 }
 
-void c_uSD::exit(void)
-{ mFS.exit();
+template <class FS>
+void c_uSD<FS>::exit(void)
+{ mFS.removeNext();
+  next=0;
+  mFS.exit();
 }
 
+template <class FS>
+void c_uSD<FS>::bench(uint8_t *buffer, uint32_t nbytes, uint32_t nbuf)
+{ // same path as recording: open, preallocate, write, header, close
+  // each buffer carries its index in the first 4 bytes, checked after close
+  static char text[512];
+  mHist tw;
+  uint64_t fsize = 512 + (uint64_t)nbuf*nbytes;
+  mFS.remove((char *)"bench.bin"); // left by interrupted run (SD would append)
+  uint32_t t0 = micros();
+  mFS.open((char *)"bench.bin");
+  bool ok = mFS.preAllocate(fsize);
+  mFS.write((uint8_t *)buffer, 512);
+  for(uint32_t ii=0; ii<nbuf; ii++)
+  { memcpy(buffer, &ii, 4);
+    MH_TIME(tw, mFS.write(buffer, nbytes));
+  }
+  mFS.writeHeader((char *)buffer, 512);
+  mFS.close();
+  uint32_t dt = micros()-t0;
+
+  // readback: size and content as written
+  uint32_t nbad = nbuf;
+  if(mFS.openRead((char *)"bench.bin"))
+  { if(mFS.fileSize() == fsize)
+    { mFS.read(buffer, 512);
+      nbad = 0;
+      for(uint32_t ii=0; ii<nbuf; ii++)
+      { mFS.read(buffer, nbytes);
+        uint32_t jj=4;
+        while(jj<nbytes && buffer[jj]==(uint8_t)jj) jj++;
+        if(memcmp(buffer, &ii, 4) || jj<nbytes) nbad++;
+      }
+    }
+    mFS.close();
+  }
+  mFS.remove((char *)"bench.bin");
+  for(uint32_t jj=0; jj<4; jj++) buffer[jj] = jj;
+
+  int nc = sprintf(text, "bench %s: %d x %d bytes (%s, %s); %d kB/s; readback %s (%d bad)\r\n",
+                   FS_NAME, nbuf, nbytes,
+                   ok ? "contiguous" : "not preallocated", mFS.writeMode(),
+                   (uint32_t)((uint64_t)nbuf*nbytes*1000/(dt ? dt : 1)),
+                   nbad ? "FAILED" : "ok", nbad);
+  tw.sprint(text+nc, " write");
+  appendLog(text);
+  Serial.print(text);
+}
+
+template <class FS>
+void c_uSD<FS>::idle(void)
+{ // create and preallocate next file, so that rollover is only a rename
+  if(state<0 || next) return;
+  if(mFS.poolLeft()) return;
+  uint64_t nalloc = nextFileSize(state>0);
+  if(!nalloc) return;
+  uint32_t t0_ = micros();
+  mFS.pause(); // no file system commands during multi-block write
+  if(!mFS.openNext((char *)"next.tmp")) { next=-1; return; } // file system without support
+  if(!mFS.preAllocateNext(nalloc))
+  { char text[80];
+    sprintf(text, "next.tmp: no contiguous preallocation of %d bytes\r\n", (uint32_t)nalloc);
+    appendLog(text);
+  }
+  tNext.add(micros()-t0_);
+  next=1;
+}
 
-int16_t c_uSD::write(int16_t *data, int32_t ndat)
+template <class FS>
+void c_uSD<FS>::logStats(void)
+{ // write latency histograms of last file to log
+  static char text[2048];
+  int nc = sprintf(text, "%s: %d bytes; %s write; n min mean max (us); counts per 2^k us\r\n",
+                    filename, nbytes, mFS.writeMode());
+  #if DO_FLAC>0
+    uint32_t nraw = flac.getSamples()*NCH*SAMPLE_BYTES;
+    nc += sprintf(text+nc, " flac: %d raw bytes; %d%%\r\n", nraw, (uint32_t)(100ULL*nbytes/(nraw ? nraw : 1)));
+  #endif
+  nc += tOpen.sprint(text+nc, " open");
+  nc += tAlloc.sprint(text+nc, " alloc");
+  nc += tWrite.sprint(text+nc, " write");
+  nc += tHeader.sprint(text+nc, " header");
+  nc += tSync.sprint(text+nc, " sync");
+  nc += tClose.sprint(text+nc, " close");
+  nc += tNext.sprint(text+nc, " next");
+  appendLog(text);
+
+  tOpen.reset(); tAlloc.reset(); tWrite.reset(); tHeader.reset(); tSync.reset(); tClose.reset(); tNext.reset();
+}
+
+
+template <class FS>
+bool c_uSD<FS>::timedWrite(uint8_t *data, uint32_t ndat)
+{ uint32_t t0_ = micros();
+  uint32_t nw = mFS.write(data, ndat);
+  uint32_t dt = micros()-t0_;
+  tWrite.add(dt);
+  #if WRITE_TRACE>0
+    if(ntrace<WRITE_TRACE) trace[ntrace++] = dt;
+  #endif
+  if(nw == ndat) return true;
+  // disk error: file is closed with the data written so far, next write opens a new file
+  char text[80];
+  sprintf(text, "%s: write failed after %d bytes\r\n", filename, (uint32_t)nbytes);
+  appendLog(text);
+  #if DO_DEBUG>0
+    Serial.print(text);
+  #endif
+  return false;
+}
+
+#if WRITE_TRACE>0
+template <class FS>
+void c_uSD<FS>::dumpTrace(void)
+{ // one latency per line, '#' line with file name and write size
+  static char text[WRITE_TRACE*8+80];
+  int nc = sprintf(text, "# %s: %d bytes per write\n", filename, nbuf ? nbytes/nbuf : 0);
+  for(int ii=0; ii<ntrace; ii++) nc += sprintf(text+nc, "%d\n", trace[ii] < 9999999 ? trace[ii] : 9999999);
+  appendFile("/trace.txt", "# us per write\n", 15, text, nc);
+}
+#endif
+
+template <class FS>
+int16_t c_uSD<FS>::write(uint8_t *data, uint32_t ndat)
 {
   if(state == 0)
   { // open file
-    char *filename = makeFilename();
+    filename = makeFilename();
     if(!filename) {state=-1; return state;} // flag to do nothing anymore
     //
-    mFS.open(filename);
+    bool ok = false;
+    if(mFS.poolLeft())
+    { // preallocated file from pool
+      MH_TIME(tOpen, ok = mFS.claimPool(filename));
+    }
+    if(!ok && next>0)
+    { // file created ahead of time, its preallocation was checked then
+      MH_TIME(tOpen, ok = mFS.useNext(filename));
+      if(!ok) mFS.removeNext();
+      next=0;
+    }
+    if(!ok)
+    { MH_TIME(tOpen, mFS.open(filename));
+      uint64_t nalloc = expectedFileSize(RTC_TSR);
+      MH_TIME(tAlloc, ok = mFS.preAllocate(nalloc));
+      if(!ok)
+      { // file grows cluster by cluster
+        char text[80];
+        sprintf(text, "%s: no contiguous preallocation of %d bytes\r\n", filename, (uint32_t)nalloc);
+        appendLog(text);
+        #if DO_DEBUG>0
+          Serial.print(text);
+        #endif
+      }
+    }
+    // header is generated when file is opened
+    MH_TIME(tHeader, mFS.write((unsigned char *) headerUpdate(), 512));
 
     state=1; // flag that file is open
+    period = record_period();
+    tCheck = RTC_TSR + CHECKPOINT_S;
     nbuf=0;
+    nbytes=0;
+    #if WRITE_TRACE>0
+      ntrace=0;
+    #endif
   }
   
   if(state == 1 || state == 2)
   {  // write to disk
     state=2;
-    mFS.write((unsigned char *) data, 2*ndat);
+    #if DO_FLAC>0
+      // compress and write one disk buffer at a time
+      while(ndat>0)
+      { uint32_t nd = (ndat > DBUF_BYTES) ? DBUF_BYTES : ndat;
+        uint32_t nc = flac.encode(flacBuffer, data, nd/(NCH*SAMPLE_BYTES));
+        if(!timedWrite(flacBuffer, nc)) {state=3; break;}
+        nbytes += nc;
+        data += nd; ndat -= nd;
+      }
+    #else
+      if(timedWrite(data, ndat)) nbytes += ndat; else state=3;
+    #endif
     //
     nbuf++;
-//    if(nbuf==MAXBUF) state=3; // flag to close file
+    #if DO_SWEEP>0
+      if(nbytes>=(uint32_t)MAXBUF*BUFFERSIZE*2) state=3; // flag to close file
+    #endif
     //
     uint32_t nsec = record_or_sleep();  // check if record time is over
     if(nsec>0) state=3;
+    if(record_period()!=period) state=3; // continuous recording: next file
     //
     if(closing) {closing=0; state=3;}
+    #if CHECKPOINT_S>0
+      if(state==2 && (int32_t)(RTC_TSR-tCheck)>=0)
+      { // header with current sizes and directory entry to disk
+        // raw write (RAW_WRITE) streams only inside the directory file size, so
+        // there the entry keeps the preallocated length, not nbytes: after power
+        // loss the data length is the one of the header, the tail is unused space
+        MH_TIME(tSync, {mFS.writeHeader(headerCheck(nbytes),512); mFS.sync();});
+        tCheck = RTC_TSR + CHECKPOINT_S;
+      }
+    #endif
   }
   
   if(state == 3)
   { // update Header
-    uint32_t ndat = 512 + nbuf*BUFFERSIZE * 2;
-    wav_hdr.dLen = ndat;
-    wav_hdr.rLen = 512 + wav_hdr.dLen;
-    mFS.writeHeader((char *) &wav_hdr,512); 
+    MH_TIME(tHeader, mFS.writeHeader(headerClose(nbytes),512)); 
 
     // close file
-    mFS.close();
+    MH_TIME(tClose, mFS.close());
+    logStats();
+    #if WRITE_TRACE>0
+      dumpTrace();
+    #endif
     state=0;  // flag to open new file
+    if(next<0) next=0; // try again for next file
   }
   return state;
 }
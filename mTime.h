@@ -28,8 +28,6 @@
 //_______________________________ For File Time settings _______________________
 #include <time.h>
 #define EPOCH_YEAR 1970 //T3 RTC
-#define LEAP_YEAR(Y) (((EPOCH_YEAR+Y)>0) && !((EPOCH_YEAR+Y)%4) && ( ((EPOCH_YEAR+Y)%100) || !((EPOCH_YEAR+Y)%400) ) )
-static  const uint8_t monthDays[]={31,28,31,30,31,30,31,31,30,31,30,31}; 
 
 /*  int  tm_sec;
   int tm_min;
@@ -42,54 +40,62 @@ static  const uint8_t monthDays[]={31,28,31,30,31,30,31,31,30,31,30,31};
   int tm_isdst;
 */
 
+// constant time conversion between days since 1970-01-01 and civil date
+// (H. Hinnant, chrono-compatible low-level date algorithms)
+// years are counted from March, so that leap day is last day of year
+struct mDate { int32_t year; uint32_t mon, mday; }; // mon: jan is 1
+
+constexpr int32_t days_from_civil(int32_t y, uint32_t m, uint32_t d)
+{ y -= (m <= 2);
+  const int32_t era = (y >= 0 ? y : y-399) / 400;
+  const uint32_t yoe = (uint32_t)(y - era*400);                  // [0, 399]
+  const uint32_t doy = (153*(m > 2 ? m-3 : m+9) + 2)/5 + d - 1;  // [0, 365]
+  const uint32_t doe = yoe*365 + yoe/4 - yoe/100 + doy;          // [0, 146096]
+  return era*146097 + (int32_t)doe - 719468;
+}
+
+constexpr mDate civil_from_days(int32_t z)
+{ z += 719468;
+  const int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+  const uint32_t doe = (uint32_t)(z - era*146097);                  // [0, 146096]
+  const uint32_t yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365; // [0, 399]
+  const uint32_t doy = doe - (365*yoe + yoe/4 - yoe/100);          // [0, 365]
+  const uint32_t mp = (5*doy + 2)/153;                             // [0, 11]
+  const uint32_t d = doy - (153*mp + 2)/5 + 1;                     // [1, 31]
+  const uint32_t m = (mp < 10) ? mp + 3 : mp - 9;                  // [1, 12]
+  return mDate{ (int32_t)yoe + era*400 + (m <= 2), m, d };
+}
+
+static_assert(days_from_civil(1970, 1, 1) == 0, "epoch");
+static_assert(days_from_civil(2000, 3, 1) == 11017, "leap day 2000");
+static_assert(civil_from_days(11016).mday == 29, "leap day 2000");
+
 struct tm seconds2tm(uint32_t tt)
-{ struct tm tx;
+{ // result is cached, repeated calls within same second are free
+  static struct tm tx;
+  static uint32_t tlast = 0;
+  static bool valid = false;
+  if(valid && tt == tlast) return tx;
+  tlast = tt;
+  valid = true;
+
   tx.tm_sec   = tt % 60;    tt /= 60; // now it is minutes
   tx.tm_min   = tt % 60;    tt /= 60; // now it is hours
   tx.tm_hour  = tt % 24;    tt /= 24; // now it is days
-  tx.tm_wday  = ((tt + 4) % 7) + 1;   // Sunday is day 1 (tbv)
-
-  // tt is now days since EPOCH_Year (1970)
-  uint32_t year = 0;  
-  uint32_t days = 0;
-  while((unsigned)(days += (LEAP_YEAR(year) ? 366 : 365)) <= tt) year++;
-
-  tx.tm_year = 1970+year; // year is NOT offset from 1970 
+  tx.tm_wday  = (tt + 4) % 7;         // Sunday is day 0 (as gmtime)
 
-  // correct for last (actual) year
-  days -= (LEAP_YEAR(year) ? 366 : 365);
-  tt  -= days; // now tt is days in this year, starting at 0
-  
-  uint32_t mm=0;
-  uint32_t monthLength=0;
-  for (mm=0; mm<12; mm++) 
-  { monthLength = monthDays[mm];
-    if ((mm==1) & LEAP_YEAR(year)) monthLength++; 
-    if (tt<monthLength) break;
-    tt -= monthLength;
-  }
-  tx.tm_mon = mm + 1;   // jan is month 1  
-  tx.tm_mday = tt + 1;     // day of month
+  mDate dx = civil_from_days(tt);
+  tx.tm_year = dx.year;     // year is NOT offset from 1970
+  tx.tm_mon = dx.mon;       // jan is month 1
+  tx.tm_mday = dx.mday;     // day of month
+  tx.tm_yday = tt - days_from_civil(dx.year, 1, 1);
+  tx.tm_isdst = 0;
   return tx;
 }
 
 uint32_t tm2seconds (struct tm *tx) 
 {
-  uint32_t tt;
-  tt=tx->tm_sec+tx->tm_min*60+tx->tm_hour*3600;  
-
-  // count days size epoch until previous midnight
-  uint32_t days=tx->tm_mday-1;
-
-  int32_t mm=0;
-//  uint32_t monthLength=0;
-  for (mm=0; mm<(tx->tm_mon-1); mm++) days+=monthDays[mm]; 
-  if(tx->tm_mon>2 && LEAP_YEAR(tx->tm_year-1970)) days++;
-
-  int32_t years=0;
-  while(years++ < (tx->tm_year-1970)) days += (LEAP_YEAR(years) ? 366 : 365);
-  //  
-  tt+=(days*24*3600);
-  return tt;
+  uint32_t days = days_from_civil(tx->tm_year, tx->tm_mon, tx->tm_mday);
+  return tx->tm_sec + tx->tm_min*60 + tx->tm_hour*3600 + days*86400;
 }
 #endif
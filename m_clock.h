@@ -0,0 +1,94 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+#ifndef M_CLOCK_H
+#define M_CLOCK_H
+
+#include <math.h>
+#include "kinetis.h"
+#include "core_pins.h"
+#include "m_queue.h"
+
+// sample clock calibration against the RTC
+// the RTC seconds interrupt latches the stream sample count, interpolated with the
+// cycle counter from the arrival of the last acquisition block. a least-squares line
+// through (RTC second, sample count) over a file gives the effective sample rate,
+// which differs from nominal by the MCLK divider error and the crystal tolerances.
+// the fit is on deviations from nominal, so double precision is kept for long files
+#define MC_NLATCH 8 // latches kept until polled
+
+class mClock
+{
+public:
+  void begin(mQueueStats *q, double fs, uint32_t blockSamples)
+  { queue = q;
+    fsNom = fs;
+    nBlock = blockSamples;
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+    reset();
+    attachInterruptVector(IRQ_RTC_SECOND, isr);
+    NVIC_SET_PRIORITY(IRQ_RTC_SECOND, 13*16); // below acquisition, which may interrupt a latch
+    NVIC_ENABLE_IRQ(IRQ_RTC_SECOND);
+    RTC_IER |= RTC_IER_TSIE;
+  }
+  void end(void) { RTC_IER &= ~RTC_IER_TSIE; NVIC_DISABLE_IRQ(IRQ_RTC_SECOND); }
+  void reset(void) { n = 0; sx = sy = sxx = sxy = syy = 0; } // new file
+  void poll(void)
+  { // fit latches of current file
+    while (lTail != lHead)
+    { uint16_t t = (lTail + 1) % MC_NLATCH;
+      double cnt = (double)latch[t].nb*nBlock + latch[t].dc*fsNom/F_CPU;
+      if (!n) { sec0 = latch[t].sec; cnt0 = cnt; }
+      double x = (int32_t)(latch[t].sec - sec0);
+      double y = cnt - cnt0 - fsNom*x;
+      lTail = t;
+      n++; sx += x; sy += y; sxx += x*x; sxy += x*y; syy += y*y;
+    }
+  }
+  int sprint(char *txt)
+  { // effective rate, deviation from nominal and rms residual of latches
+    double d = n*sxx - sx*sx;
+    if (n < 3 || d <= 0) return sprintf(txt, "fs %d (nominal)", (int)fsNom);
+    double b = (n*sxy - sx*sy)/d, a = (sy - b*sx)/n;
+    double res = (syy - a*sy - b*sxy)/(n-2);
+    double fs = fsNom + b;
+    uint32_t ufs = fs*10000+0.5; // 4 decimals without float printf
+    int32_t ppb = lround(b/fsNom*1e9);
+    return sprintf(txt, "fs %d.%04d; ppm %c%d.%03d; res %dus", (int)(ufs/10000), (int)(ufs%10000),
+                   ppb<0 ? '-' : '+', abs(ppb)/1000, abs(ppb)%1000, (int)(sqrt(res > 0 ? res : 0)/fs*1e6 + 0.5));
+  }
+  double rate(void)
+  { double d = n*sxx - sx*sx;
+    return (n < 3 || d <= 0) ? fsNom : fsNom + (n*sxy - sx*sy)/d;
+  }
+private:
+  static void isr(void);
+  static mQueueStats *queue;
+  static struct latch_s { uint32_t sec, nb, dc; } latch[MC_NLATCH];
+  static volatile uint16_t lHead, lTail;
+  double fsNom; // rate of the I2S dividers, deviations are from MCLK (crystal, PLL)
+  uint32_t nBlock, n, sec0;
+  double cnt0, sx, sy, sxx, sxy, syy;
+};
+mQueueStats *mClock::queue = 0;
+mClock::latch_s mClock::latch[MC_NLATCH];
+volatile uint16_t mClock::lHead = 0, mClock::lTail = 0;
+
+void mClock::isr(void)
+{
+  uint32_t cb, nb = queue->getStamp(&cb);
+  uint32_t c = ARM_DWT_CYCCNT; // after stamp, a newer block only extends the interpolation
+  uint32_t sec = RTC_TSR; // seconds interrupt follows the TSR increment
+  if (!nb) return; // no acquisition yet
+  uint16_t h = (lHead + 1) % MC_NLATCH;
+  if (h == lTail) return; // not polled, skip
+  latch[h].sec = sec;
+  latch[h].nb = nb;
+  latch[h].dc = c - cb;
+  MQ_BARRIER();
+  lHead = h;
+}
+
+#endif
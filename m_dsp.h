@@ -0,0 +1,136 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+#ifndef M_DSP_H
+#define M_DSP_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// signal processing kernels for the acquisition path
+// Cortex-M4 DSP instructions are used where available, the C versions
+// give identical results (and allow testing on other platforms)
+
+#if defined(__ARM_ARCH_7EM__)
+// (a & 0xFFFF) | (b << 16)
+static inline uint32_t pkhbt(uint32_t a, uint32_t b)
+{ uint32_t r; asm ("pkhbt %0, %1, %2, lsl #16" : "=r" (r) : "r" (a), "r" (b)); return r; }
+// (a & 0xFFFF0000) | (b >> 16)
+static inline uint32_t pkhtb(uint32_t a, uint32_t b)
+{ uint32_t r; asm ("pkhtb %0, %1, %2, asr #16" : "=r" (r) : "r" (a), "r" (b)); return r; }
+// acc + a.lo*b.lo + a.hi*b.hi
+static inline int32_t smlad(uint32_t a, uint32_t b, int32_t acc)
+{ int32_t r; asm ("smlad %0, %1, %2, %3" : "=r" (r) : "r" (a), "r" (b), "r" (acc)); return r; }
+// saturate to 16 bit
+static inline int32_t ssat16(int32_t a)
+{ int32_t r; asm ("ssat %0, #16, %1" : "=r" (r) : "r" (a)); return r; }
+#else
+static inline uint32_t pkhbt(uint32_t a, uint32_t b) { return (a & 0xFFFF) | (b << 16); }
+static inline uint32_t pkhtb(uint32_t a, uint32_t b) { return (a & 0xFFFF0000) | (b >> 16); }
+static inline int32_t smlad(uint32_t a, uint32_t b, int32_t acc)
+{ return acc + (int16_t)a*(int16_t)b + (int16_t)(a>>16)*(int16_t)(b>>16); }
+static inline int32_t ssat16(int32_t a) { return (a > 32767) ? 32767 : (a < -32768) ? -32768 : a; }
+#endif
+
+// interleave two channels of n (multiple of 4) 16 bit samples
+// each word of l, r holds two consecutive samples
+static inline void interleave2(uint32_t *dst, const uint32_t *l, const uint32_t *r, int n)
+{
+  for(int ii=0; ii<n/2; ii+=2)
+  { uint32_t l0 = l[ii], l1 = l[ii+1];
+    uint32_t r0 = r[ii], r1 = r[ii+1];
+    dst[0] = pkhbt(l0, r0);
+    dst[1] = pkhtb(r0, l0);
+    dst[2] = pkhbt(l1, r1);
+    dst[3] = pkhtb(r1, l1);
+    dst += 4;
+  }
+}
+
+// extract one channel (sel: 0 left, 1 right) of n (multiple of 4) stereo frames
+// each word of src holds one frame (left in lower half word)
+static inline void deinterleave1(uint32_t *dst, const uint32_t *src, int n, int sel)
+{
+  if(sel==0)
+    for(int ii=0; ii<n; ii+=4)
+    { dst[0] = pkhbt(src[0], src[1]);
+      dst[1] = pkhbt(src[2], src[3]);
+      dst += 2; src += 4;
+    }
+  else
+    for(int ii=0; ii<n; ii+=4)
+    { dst[0] = pkhtb(src[1], src[0]);
+      dst[1] = pkhtb(src[3], src[2]);
+      dst += 2; src += 4;
+    }
+}
+
+// pack n (multiple of 4) 32 bit I2S words (24 bit data left aligned) into
+// 3 byte samples, taking every stride-th word of src
+static inline void pack24(uint32_t *dst, const uint32_t *src, int n, int stride)
+{
+  for(int ii=0; ii<n; ii+=4)
+  { uint32_t s0 = src[0], s1 = src[stride], s2 = src[2*stride], s3 = src[3*stride];
+    dst[0] = (s0 >> 8)  | ((s1 & 0x0000FF00) << 16);
+    dst[1] = (s1 >> 16) | ((s2 & 0x00FFFF00) << 8);
+    dst[2] = (s2 >> 24) |  (s3 & 0xFFFFFF00);
+    dst += 3; src += 4*stride;
+  }
+}
+
+// copy n words
+static inline void copy32(uint32_t *dst, const uint32_t *src, int n)
+{
+  for(int ii=0; ii<n; ii+=4)
+  { dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = src[3];
+    dst += 4; src += 4;
+  }
+}
+
+// decimation by D (2, 4, 8) with Q15 FIR of NT taps (multiple of 8)
+// only every D-th output is computed (polyphase), two taps per SMLAD
+// coefficients are a Blackman windowed sinc with cutoff at half output rate
+// samples of last NT inputs are kept, so consecutive blocks are continuous
+template <int D, int NT>
+class mDecimator
+{
+public:
+  mDecimator(void) { init(); }
+  void init(void)
+  { float sum = 0, hf[NT];
+    for(int ii=0; ii<NT; ii++)
+    { float t = ii - (NT-1)/2.0f;
+      float w = 0.42f - 0.5f*cosf(2*M_PI*(ii+0.5f)/NT) + 0.08f*cosf(4*M_PI*(ii+0.5f)/NT);
+      hf[ii] = w * ((t == 0) ? 1.0f : sinf(M_PI*t/D)/(M_PI*t/D));
+      sum += hf[ii];
+    }
+    // store time reversed, so that taps run with increasing sample index
+    for(int ii=0; ii<NT; ii++) ((int16_t *)coeff)[ii] = lrintf(32768.0f*hf[NT-1-ii]/sum);
+    memset(buf, 0, sizeof(buf));
+  }
+  // n (multiple of D, at most NMAX) input samples src[ii*ss]; n/D outputs to dst[jj*ds]
+  void process(int16_t *dst, int ds, const int16_t *src, int ss, int n)
+  { int16_t *x = (int16_t *) buf;
+    for(int ii=0; ii<n; ii++) x[NT+ii] = src[ii*ss];
+    for(int jj=0; jj<n/D; jj++)
+    { // window starts at (even) sample jj*D + D, ends with newest input of group
+      const uint32_t *xp = &buf[(jj*D + D)/2];
+      int32_t acc = 1<<14;
+      for(int kk=0; kk<NT/2; kk+=4)
+      { acc = smlad(coeff[kk], xp[kk], acc);
+        acc = smlad(coeff[kk+1], xp[kk+1], acc);
+        acc = smlad(coeff[kk+2], xp[kk+2], acc);
+        acc = smlad(coeff[kk+3], xp[kk+3], acc);
+      }
+      dst[jj*ds] = ssat16(acc >> 15);
+    }
+    copy32(buf, &buf[n/2], NT/2);
+  }
+  static const int NMAX = 128;
+private:
+  uint32_t coeff[NT/2];
+  uint32_t buf[(NT+NMAX)/2];
+};
+
+#endif
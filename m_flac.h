@@ -0,0 +1,316 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+#ifndef M_FLAC_H
+#define M_FLAC_H
+
+#include <stdint.h>
+#include <string.h>
+
+// streaming FLAC encoder (see https://xiph.org/flac/format.html)
+// fixed linear prediction (order 0..4) with partitioned Rice coding of residuals
+// channels are coded independently; no MD5 signature
+// frames use the variable blocksize strategy (header carries first sample number)
+// so that any number of frames (>=16) can be encoded per call
+//
+// the 512 byte file header holds STREAMINFO and a VORBIS_COMMENT block
+// with a single fixed size comment ("COMMENT=" + MF_INFO chars of free text)
+#define MF_HDR 512
+#define MF_INFO (MF_HDR - 62 - 8)
+#define MF_MAXPORDER 4  // max Rice partition order
+#define MF_OVERHEAD 32  // max bytes per frame beyond raw sample data
+
+static uint8_t mf_crc8[256];
+static uint16_t mf_crc16[256];
+
+static void mf_initCRC(void)
+{ for(int ii=0; ii<256; ii++)
+  { uint8_t c8 = ii;
+    uint16_t c16 = ii<<8;
+    for(int jj=0; jj<8; jj++)
+    { c8 = (c8 & 0x80) ? (c8<<1) ^ 0x07 : (c8<<1);
+      c16 = (c16 & 0x8000) ? (c16<<1) ^ 0x8005 : (c16<<1);
+    }
+    mf_crc8[ii] = c8;
+    mf_crc16[ii] = c16;
+  }
+}
+
+// big-endian bit writer
+class mBitWriter
+{
+public:
+  void begin(uint8_t *p) { bp = p; acc = 0; nacc = 0; }
+  // write n (<=32) bits of v (v < 2^n)
+  inline void put(uint32_t v, int n)
+  { acc = (acc << n) | v;
+    nacc += n;
+    if(nacc >= 32)
+    { nacc -= 32;
+      uint32_t w = acc >> nacc;
+      bp[0] = w>>24; bp[1] = w>>16; bp[2] = w>>8; bp[3] = w;
+      bp += 4;
+    }
+  }
+  // q zeros, one, k low bits of u
+  inline void rice(uint32_t u, int k)
+  { uint32_t q = u >> k;
+    if(q + 1 + k <= 32)
+      put((1u << k) | (u & ((1u << k) - 1)), q + 1 + k);
+    else
+    { for(; q >= 32; q -= 32) put(0, 32);
+      put(1, q + 1);
+      if(k) put(u & ((1u << k) - 1), k);
+    }
+  }
+  // pad to byte boundary and return end of data
+  uint8_t * flush(void)
+  { if(nacc & 7) put(0, 8 - (nacc & 7));
+    for(; nacc > 0; nacc -= 8) *bp++ = acc >> (nacc - 8);
+    return bp;
+  }
+private:
+  uint8_t *bp;
+  uint64_t acc;
+  int nacc;
+};
+
+// NC channels, NB bits per sample (16, 24), max NBLK samples per channel and frame
+template <int NC, int NB, int NBLK>
+class mFlacEncoder
+{
+public:
+  mFlacEncoder(void) { mf_initCRC(); begin(0); }
+  // new stream (file)
+  void begin(uint32_t fs) { fsamp = fs; nsamp = 0; minBlk = NBLK; minFrame = 0xffffff; maxFrame = 0; text[0] = 0; }
+  // free text of file header (MF_INFO chars)
+  char * info(void) { return text; }
+  // 512 byte file header with current stream totals
+  char * header(void);
+  // encode nframes interleaved samples, returns number of bytes written to dst
+  // dst must hold nframes*NC*NB/8 + (nframes/NBLK+1)*MF_OVERHEAD bytes
+  uint32_t encode(uint8_t *dst, const uint8_t *src, uint32_t nframes);
+  uint64_t getSamples(void) { return nsamp; }
+
+private:
+  static const uint32_t MASK = (NB == 32) ? 0xffffffff : ((1u << NB) - 1);
+  static const int PBITS = (NB > 16) ? 5 : 4; // bits of Rice parameter
+  static const int KMAX = (NB > 16) ? 30 : 14;
+
+  uint32_t fsamp;
+  uint64_t nsamp;
+  uint32_t minBlk, minFrame, maxFrame;
+  char text[MF_INFO+1];
+  uint8_t hdr[MF_HDR];
+  int32_t x[NBLK];
+  mBitWriter bw;
+
+  uint32_t encodeFrame(uint8_t *dst, const uint8_t *src, uint32_t nf);
+  void subframe(uint32_t n);
+  void verbatim(uint32_t n);
+  void residual(int order, uint32_t n);
+  void restore(int order, uint32_t n);
+  static uint8_t * le32(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v>>8; p[2] = v>>16; p[3] = v>>24; return p+4; }
+  static inline uint32_t zigzag(int32_t r) { return ((uint32_t) r << 1) ^ (r >> 31); }
+};
+
+template <int NC, int NB, int NBLK>
+char * mFlacEncoder<NC,NB,NBLK>::header(void)
+{
+  uint8_t *p = hdr;
+  memcpy(p, "fLaC", 4); p += 4;
+  // STREAMINFO
+  *p++ = 0x00; *p++ = 0; *p++ = 0; *p++ = 34;
+  bw.begin(p);
+  bw.put(minBlk, 16);
+  bw.put(NBLK, 16);
+  bw.put(maxFrame ? minFrame : 0, 24);
+  bw.put(maxFrame, 24);
+  bw.put(fsamp, 20);
+  bw.put(NC-1, 3);
+  bw.put(NB-1, 5);
+  bw.put((uint32_t)(nsamp >> 32) & 0xf, 4);
+  bw.put((uint32_t) nsamp, 32);
+  for(int ii=0; ii<4; ii++) bw.put(0, 32); // MD5 not computed
+  p = bw.flush();
+  // VORBIS_COMMENT (last metadata block), lengths are little endian
+  uint32_t len = MF_HDR - (p - hdr) - 4;
+  *p++ = 0x84; *p++ = len>>16; *p++ = len>>8; *p++ = len;
+  p = le32(p, 4);
+  memcpy(p, "WMXZ", 4); p += 4;
+  p = le32(p, 1);
+  p = le32(p, 8 + MF_INFO);
+  memcpy(p, "COMMENT=", 8); p += 8;
+  // free text padded with blanks
+  int nt = strlen(text);
+  memcpy(p, text, nt);
+  memset(p + nt, ' ', MF_INFO - nt);
+  return (char *) hdr;
+}
+
+template <int NC, int NB, int NBLK>
+uint32_t mFlacEncoder<NC,NB,NBLK>::encode(uint8_t *dst, const uint8_t *src, uint32_t nframes)
+{
+  uint8_t *p = dst;
+  while(nframes > 0)
+  { uint32_t nf = (nframes > NBLK) ? NBLK : nframes;
+    uint32_t nb = encodeFrame(p, src, nf);
+    if(nb < minFrame) minFrame = nb;
+    if(nb > maxFrame) maxFrame = nb;
+    if(nf < minBlk) minBlk = nf;
+    nsamp += nf;
+    p += nb;
+    src += nf*NC*(NB/8);
+    nframes -= nf;
+  }
+  return p - dst;
+}
+
+template <int NC, int NB, int NBLK>
+uint32_t mFlacEncoder<NC,NB,NBLK>::encodeFrame(uint8_t *dst, const uint8_t *src, uint32_t nf)
+{
+  uint8_t *p = dst;
+  *p++ = 0xFF; *p++ = 0xF9; // sync code, variable blocksize
+  *p++ = 0x70; // blocksize at end of header, sample rate from STREAMINFO
+  *p++ = ((NC-1) << 4) | (((NB == 16) ? 4 : 6) << 1); // independent channels, sample size
+  // first sample number, UTF-8 like coding (up to 36 bits)
+  uint64_t v = nsamp;
+  if(v < 0x80) *p++ = v;
+  else
+  { int nc = 2;
+    while(nc < 7 && (v >> (5*nc + 1))) nc++;
+    *p++ = (0xff << (8 - nc)) | (v >> (6*(nc-1)));
+    for(int ii = nc-2; ii >= 0; ii--) *p++ = 0x80 | ((v >> (6*ii)) & 0x3f);
+  }
+  *p++ = (nf-1) >> 8; *p++ = (nf-1);
+  uint8_t crc8 = 0;
+  for(uint8_t *q = dst; q < p; q++) crc8 = mf_crc8[crc8 ^ *q];
+  *p++ = crc8;
+
+  bw.begin(p);
+  for(int ic = 0; ic < NC; ic++)
+  { // extract channel
+    if(NB == 16)
+    { const int16_t *s = (const int16_t *) src + ic;
+      for(uint32_t ii = 0; ii < nf; ii++) x[ii] = s[ii*NC];
+    }
+    else
+    { const uint8_t *s = src + 3*ic;
+      for(uint32_t ii = 0; ii < nf; ii++, s += 3*NC)
+        x[ii] = ((int32_t)((s[0] << 8) | (s[1] << 16) | (s[2] << 24))) >> 8;
+    }
+    subframe(nf);
+  }
+  p = bw.flush();
+
+  uint16_t crc16 = 0;
+  for(uint8_t *q = dst; q < p; q++) crc16 = (crc16 << 8) ^ mf_crc16[(crc16 >> 8) ^ *q];
+  *p++ = crc16 >> 8; *p++ = crc16;
+  return p - dst;
+}
+
+template <int NC, int NB, int NBLK>
+void mFlacEncoder<NC,NB,NBLK>::verbatim(uint32_t n)
+{
+  bw.put(0x02, 8);
+  for(uint32_t ii = 0; ii < n; ii++) bw.put(x[ii] & MASK, NB);
+}
+
+template <int NC, int NB, int NBLK>
+void mFlacEncoder<NC,NB,NBLK>::subframe(uint32_t n)
+{
+  uint32_t ii;
+  for(ii = 1; ii < n && x[ii] == x[0]; ii++) ;
+  if(ii == n) { bw.put(0x00, 8); bw.put(x[0] & MASK, NB); return; } // constant
+  if(n < 16) { verbatim(n); return; }
+
+  // select predictor order with smallest sum of absolute residuals
+  uint64_t sum[5] = {0, 0, 0, 0, 0};
+  int32_t l0 = x[3], l1 = x[3] - x[2], l2 = l1 - (x[2] - x[1]), l3 = l2 - (x[2] - 2*x[1] + x[0]);
+  for(ii = 4; ii < n; ii++)
+  { int32_t e0 = x[ii], e1 = e0 - l0, e2 = e1 - l1, e3 = e2 - l2, e4 = e3 - l3;
+    l0 = e0; l1 = e1; l2 = e2; l3 = e3;
+    sum[0] += (e0 < 0) ? -e0 : e0;
+    sum[1] += (e1 < 0) ? -e1 : e1;
+    sum[2] += (e2 < 0) ? -e2 : e2;
+    sum[3] += (e3 < 0) ? -e3 : e3;
+    sum[4] += (e4 < 0) ? -e4 : e4;
+  }
+  int order = 0;
+  for(int jj = 1; jj < 5; jj++) if(sum[jj] < sum[order]) order = jj;
+
+  residual(order, n);
+
+  // Rice partitions: sums of zigzag residuals for finest partition order
+  int pmax = MF_MAXPORDER;
+  while(pmax > 0 && ((n & ((1u << pmax) - 1)) || (n >> pmax) <= (uint32_t) order)) pmax--;
+  uint64_t psum[1 << MF_MAXPORDER];
+  int np = 1 << pmax;
+  uint32_t m = n >> pmax;
+  for(int jj = 0; jj < np; jj++)
+  { uint64_t s = 0;
+    for(ii = (jj == 0) ? order : jj*m; ii < (jj+1)*m; ii++) s += zigzag(x[ii]);
+    psum[jj] = s;
+  }
+  // merge partitions and keep cheapest partition order
+  uint64_t best = ~0ULL;
+  int bestOrder = 0;
+  uint8_t kbest[1 << MF_MAXPORDER];
+  for(int po = pmax; po >= 0; po--)
+  { uint8_t kk[1 << MF_MAXPORDER];
+    uint64_t bits = 0;
+    for(int jj = 0; jj < np; jj++)
+    { uint32_t mj = (n >> po) - ((jj == 0) ? order : 0);
+      int k = 0;
+      while(k < KMAX && ((uint64_t) mj << (k+1)) < psum[jj]) k++;
+      kk[jj] = k;
+      bits += PBITS + (uint64_t) mj*(k+1) + (psum[jj] >> k);
+    }
+    if(bits < best) { best = bits; bestOrder = po; memcpy(kbest, kk, np); }
+    if(po > 0) { np /= 2; for(int jj = 0; jj < np; jj++) psum[jj] = psum[2*jj] + psum[2*jj+1]; }
+  }
+  // compare with verbatim coding (estimated bits are an upper limit)
+  if(order*NB + 6 + best >= n*NB) { restore(order, n); verbatim(n); return; }
+
+  bw.put(0x10 | (order << 1), 8);
+  for(int jj = 0; jj < order; jj++) bw.put(x[jj] & MASK, NB);
+  bw.put((NB > 16) ? 1 : 0, 2);
+  bw.put(bestOrder, 4);
+  np = 1 << bestOrder;
+  m = n >> bestOrder;
+  for(int jj = 0; jj < np; jj++)
+  { int k = kbest[jj];
+    bw.put(k, PBITS);
+    for(ii = (jj == 0) ? order : jj*m; ii < (jj+1)*m; ii++)
+      bw.rice(zigzag(x[ii]), k);
+  }
+}
+
+// fixed predictor residual, in place from the end (warm-up samples are kept)
+template <int NC, int NB, int NBLK>
+void mFlacEncoder<NC,NB,NBLK>::residual(int order, uint32_t n)
+{
+  int32_t *r = x;
+  switch(order)
+  { case 1: for(int ii = n-1; ii >= 1; ii--) r[ii] -= x[ii-1]; break;
+    case 2: for(int ii = n-1; ii >= 2; ii--) r[ii] -= 2*x[ii-1] - x[ii-2]; break;
+    case 3: for(int ii = n-1; ii >= 3; ii--) r[ii] -= 3*(x[ii-1] - x[ii-2]) + x[ii-3]; break;
+    case 4: for(int ii = n-1; ii >= 4; ii--) r[ii] -= 4*(x[ii-1] + x[ii-3]) - 6*x[ii-2] - x[ii-4]; break;
+    default: break;
+  }
+}
+
+// inverse of residual()
+template <int NC, int NB, int NBLK>
+void mFlacEncoder<NC,NB,NBLK>::restore(int order, uint32_t n)
+{
+  switch(order)
+  { case 1: for(uint32_t ii = 1; ii < n; ii++) x[ii] += x[ii-1]; break;
+    case 2: for(uint32_t ii = 2; ii < n; ii++) x[ii] += 2*x[ii-1] - x[ii-2]; break;
+    case 3: for(uint32_t ii = 3; ii < n; ii++) x[ii] += 3*(x[ii-1] - x[ii-2]) + x[ii-3]; break;
+    case 4: for(uint32_t ii = 4; ii < n; ii++) x[ii] += 4*(x[ii-1] + x[ii-3]) - 6*x[ii-2] - x[ii-4]; break;
+    default: break;
+  }
+}
+
+#endif
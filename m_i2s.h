@@ -0,0 +1,190 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+ 
+
+// I2S input that de-interleaves the DMA buffer directly into the
+// acquisition blocks provided by a disk queue (e.g. mDiskQueue)
+// there are no audio_block_t and no AudioStream updates involved
+// NC is number of channels to be stored (1, 2)
+// SEL selects the channel to be stored if NC==1 (0 left, 1 right)
+// NB is number of bits per sample (16, 24), 24 bit samples are stored packed in 3 bytes
+// DF is decimation factor (1, 2, 4, 8) with FIR of NT taps (16 bit only)
+
+#ifndef M_I2S_H
+#define M_I2S_H
+
+#include "kinetis.h"
+#include "core_pins.h"
+#include "DMAChannel.h"
+#include "i2s_mods.h"
+#include "m_dsp.h"
+#include "m_prof.h"
+
+#define MI2S_NFRAMES 128 // frames per DMA half buffer (one acquisition block)
+
+// decimators of the stored channels (filter state and coefficients),
+// empty without decimation (DF==1)
+template <int NC, int SEL, int DF, int NT>
+struct mI2SDecim
+{
+	mDecimator<DF,NT> dec[NC];
+	// each channel of 16 bit frames s into its place of the output frames
+	void process(int16_t *dst, const int16_t *s)
+	{
+		if (NC == 2) {
+			dec[0].process(dst, 2, s, 2, MI2S_NFRAMES);
+			dec[1].process(dst + 1, 2, s + 1, 2, MI2S_NFRAMES);
+		} else
+			dec[0].process(dst, 1, s + SEL, 2, MI2S_NFRAMES);
+	}
+};
+template <int NC, int SEL, int NT>
+struct mI2SDecim<NC,SEL,1,NT>
+{
+	void process(int16_t *, const int16_t *) { }
+};
+
+template <class Q, int NC, int SEL, int NB=16, int DF=1, int NT=8>
+class mInputI2S
+{
+public:
+	void begin(Q *q, uint32_t fsamp);
+	void end(void) { dma.disable(); }
+private:
+	static Q *queue;
+	static DMAChannel dma;
+	static void isr(void);
+	static void config_i2s(uint32_t fsamp);
+	// 16 bit: one frame (left, right) per word; 24 bit: one slot per word
+	static const int NW = (NB == 16) ? 2*MI2S_NFRAMES : 4*MI2S_NFRAMES;
+	static uint32_t rx_buffer[NW];
+	static mI2SDecim<NC,SEL,DF,NT> decim;
+};
+
+template <class Q, int NC, int SEL, int NB, int DF, int NT> Q * mInputI2S<Q,NC,SEL,NB,DF,NT>::queue = NULL;
+template <class Q, int NC, int SEL, int NB, int DF, int NT> DMAChannel mInputI2S<Q,NC,SEL,NB,DF,NT>::dma(false);
+template <class Q, int NC, int SEL, int NB, int DF, int NT> DMAMEM uint32_t mInputI2S<Q,NC,SEL,NB,DF,NT>::rx_buffer[NW];
+template <class Q, int NC, int SEL, int NB, int DF, int NT> mI2SDecim<NC,SEL,DF,NT> mInputI2S<Q,NC,SEL,NB,DF,NT>::decim;
+
+template <class Q, int NC, int SEL, int NB, int DF, int NT>
+void mInputI2S<Q,NC,SEL,NB,DF,NT>::begin(Q *q, uint32_t fsamp)
+{
+	queue = q;
+	dma.begin(true); // Allocate the DMA channel first
+
+	config_i2s(fsamp);
+	CORE_PIN13_CONFIG = PORT_PCR_MUX(4); // pin 13, PTC5, I2S0_RXD0
+
+	if (NB == 16) {
+		dma.TCD->SADDR = (void *)((uint32_t)&I2S0_RDR0 + 2); // upper 16 bits of slot
+		dma.TCD->ATTR = DMA_TCD_ATTR_SSIZE(1) | DMA_TCD_ATTR_DSIZE(1);
+		dma.TCD->NBYTES_MLNO = 2;
+		dma.TCD->DOFF = 2;
+	} else {
+		dma.TCD->SADDR = (void *)&I2S0_RDR0; // full 32 bit slot
+		dma.TCD->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);
+		dma.TCD->NBYTES_MLNO = 4;
+		dma.TCD->DOFF = 4;
+	}
+	dma.TCD->SOFF = 0;
+	dma.TCD->SLAST = 0;
+	dma.TCD->DADDR = rx_buffer;
+	dma.TCD->CITER_ELINKNO = sizeof(rx_buffer) / dma.TCD->NBYTES_MLNO;
+	dma.TCD->DLASTSGA = -sizeof(rx_buffer);
+	dma.TCD->BITER_ELINKNO = sizeof(rx_buffer) / dma.TCD->NBYTES_MLNO;
+	dma.TCD->CSR = DMA_TCD_CSR_INTHALF | DMA_TCD_CSR_INTMAJOR;
+	dma.triggerAtHardwareEvent(DMAMUX_SOURCE_I2S0_RX);
+	dma.enable();
+
+	I2S0_RCSR |= I2S_RCSR_RE | I2S_RCSR_BCE | I2S_RCSR_FRDE | I2S_RCSR_FR;
+	I2S0_TCSR |= I2S_TCSR_TE | I2S_TCSR_BCE; // TX clock enable, because sync'd to TX
+	dma.attachInterrupt(isr);
+}
+
+template <class Q, int NC, int SEL, int NB, int DF, int NT>
+void mInputI2S<Q,NC,SEL,NB,DF,NT>::isr(void)
+{
+	MP_SCOPE(MP_ISR);
+	uint32_t daddr = (uint32_t)(dma.TCD->DADDR);
+	dma.clearInterrupt();
+
+	const uint32_t *src;
+	if (daddr < (uint32_t)rx_buffer + sizeof(rx_buffer) / 2) {
+		// DMA is receiving to the first half of the buffer
+		// need to remove data from the second half
+		src = &rx_buffer[NW/2];
+	} else {
+		src = &rx_buffer[0];
+	}
+
+	uint32_t *dst = (uint32_t *) queue->getBlock(); // block within disk buffer
+	if (!dst) return; // queue full (counted by queue)
+
+	if (DF > 1) {
+		decim.process((int16_t *) dst, (const int16_t *) src);
+	} else if (NB == 16) {
+		// left is lower, right is upper half word
+		if (NC == 2)
+			copy32(dst, src, MI2S_NFRAMES); // frames are already interleaved
+		else
+			deinterleave1(dst, src, MI2S_NFRAMES, SEL);
+	} else {
+		// slots alternate left, right
+		if (NC == 2)
+			pack24(dst, src, 2*MI2S_NFRAMES, 1);
+		else
+			pack24(dst, src + SEL, MI2S_NFRAMES, 2);
+	}
+	queue->putBlock(MI2S_NFRAMES / DF * NC * (NB/8));
+}
+
+// adapted from stock AudioOutputI2S::config_i2s
+// clock dividers are set for fsamp with 32 bit slots
+template <class Q, int NC, int SEL, int NB, int DF, int NT>
+void mInputI2S<Q,NC,SEL,NB,DF,NT>::config_i2s(uint32_t fsamp)
+{
+	SIM_SCGC6 |= SIM_SCGC6_I2S;
+	SIM_SCGC7 |= SIM_SCGC7_DMA;
+	SIM_SCGC6 |= SIM_SCGC6_DMAMUX;
+
+	// if either transmitter or receiver is enabled, do nothing
+	if (I2S0_TCSR & I2S_TCSR_TE) return;
+	if (I2S0_RCSR & I2S_RCSR_RE) return;
+
+	uint32_t iscl[3];
+	iscl[2] = 1;
+	I2S_dividers(iscl, fsamp, 32);
+
+	// enable MCLK output
+	I2S0_MCR = I2S_MCR_MICS(3) | I2S_MCR_MOE; // PLL
+	while (I2S0_MCR & I2S_MCR_DUF) ;
+	I2S0_MDR = I2S_MDR_FRACT(iscl[0]) | I2S_MDR_DIVIDE(iscl[1]);
+
+	// configure transmitter
+	I2S0_TMR = 0;
+	I2S0_TCR1 = I2S_TCR1_TFW(1);  // watermark at half fifo size
+	I2S0_TCR2 = I2S_TCR2_SYNC(0) | I2S_TCR2_BCP | I2S_TCR2_MSEL(1)
+		| I2S_TCR2_BCD | I2S_TCR2_DIV(iscl[2]);
+	I2S0_TCR3 = I2S_TCR3_TCE;
+	I2S0_TCR4 = I2S_TCR4_FRSZ(1) | I2S_TCR4_SYWD(31) | I2S_TCR4_MF
+		| I2S_TCR4_FSE | I2S_TCR4_FSP | I2S_TCR4_FSD;
+	I2S0_TCR5 = I2S_TCR5_WNW(31) | I2S_TCR5_W0W(31) | I2S_TCR5_FBT(31);
+
+	// configure receiver (sync'd to transmitter clocks)
+	I2S0_RMR = 0;
+	I2S0_RCR1 = I2S_RCR1_RFW(1);
+	I2S0_RCR2 = I2S_RCR2_SYNC(1) | I2S_TCR2_BCP | I2S_RCR2_MSEL(1)
+		| I2S_RCR2_BCD | I2S_RCR2_DIV(iscl[2]);
+	I2S0_RCR3 = I2S_RCR3_RCE;
+	I2S0_RCR4 = I2S_RCR4_FRSZ(1) | I2S_RCR4_SYWD(31) | I2S_RCR4_MF
+		| I2S_RCR4_FSE | I2S_RCR4_FSP | I2S_RCR4_FSD;
+	I2S0_RCR5 = I2S_RCR5_WNW(31) | I2S_RCR5_W0W(31) | I2S_RCR5_FBT(31);
+
+	// configure pin mux for 3 clock signals
+	CORE_PIN23_CONFIG = PORT_PCR_MUX(6); // pin 23, PTC2, I2S0_TX_FS (LRCLK)
+	CORE_PIN9_CONFIG  = PORT_PCR_MUX(6); // pin  9, PTC3, I2S0_TX_BCLK
+	CORE_PIN11_CONFIG = PORT_PCR_MUX(6); // pin 11, PTC6, I2S0_MCLK
+}
+
+#endif
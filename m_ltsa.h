@@ -0,0 +1,133 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+#ifndef M_LTSA_H
+#define M_LTSA_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "arm_math.h"
+
+// long-term spectral average
+// first channel is Hann windowed, transformed with CMSIS q15 radix-4 FFT
+// (as stock analyze_fft1024) and power spectra are averaged over tavg seconds
+// output per interval is one record of levels in 0.01 dB of |DFT|^2 (16 bit data)
+// either for all FFT bins or for 1/3 octave bands (base 2, 1 kHz reference)
+// band edges are given as FFT bin indices in the file header
+#define ML_MAXBAND 48
+
+template <int NC, int NB, int NFFT>
+class mLtsa
+{
+public:
+  void begin(uint32_t fsamp, uint32_t tavg, int bands); // bands: 0 FFT bins, 1 1/3 octaves
+  // add nframes of interleaved data, returns 1 if a record is complete
+  int process(const void *data, int nframes);
+  // file header and last complete record (time stamped with tt)
+  const void * header(uint32_t *nbytes) { *nbytes = sizeof(hdr); return &hdr; }
+  const void * record(uint32_t tt, uint32_t *nbytes)
+  { rec.time = tt; *nbytes = 2*sizeof(uint32_t) + hdr.nout*sizeof(int16_t); return &rec; }
+
+private:
+  arm_cfft_radix4_instance_q15 fft;
+  int16_t win[NFFT];
+  int16_t x[NFFT];
+  int16_t cbuf[2*NFFT];
+  float sum[NFFT/2];
+  int nx, bands;
+  uint32_t nspec, navg;
+  struct { char id[4]; uint32_t fsamp, nfft, tavg, nout; uint16_t edge[ML_MAXBAND+1]; } hdr;
+  struct { uint32_t time, nspec; int16_t level[NFFT/2]; } rec;
+
+  void spectrum(void);
+  void output(void);
+};
+
+template <int NC, int NB, int NFFT>
+void mLtsa<NC,NB,NFFT>::begin(uint32_t fsamp, uint32_t tavg, int nb)
+{
+  bands = nb;
+  arm_cfft_radix4_init_q15(&fft, NFFT, 0, 1);
+  for(int ii = 0; ii < NFFT; ii++)
+    win[ii] = lrintf(32767.0f*(0.5f - 0.5f*cosf(2*M_PI*ii/NFFT)));
+  memset(sum, 0, sizeof(sum));
+  nx = 0;
+  nspec = 0;
+  navg = (uint32_t)((uint64_t) tavg*fsamp/NFFT);
+  if(navg < 1) navg = 1;
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.id, "LTSA", 4);
+  hdr.fsamp = fsamp;
+  hdr.nfft = NFFT;
+  hdr.tavg = tavg;
+  if(bands)
+  { // edges of 1/3 octave bands, bands narrower than one bin are merged
+    float df = (float) fsamp/NFFT;
+    int ne = 0;
+    for(int kk = -30; kk < 30 && ne < ML_MAXBAND; kk++)
+    { int ee = lrintf(1000.0f*powf(2.0f, (kk - 0.5f)/3.0f)/df);
+      if(ee < 1) continue;
+      if(ee >= NFFT/2) break;
+      if(ne == 0 || ee > hdr.edge[ne-1]) hdr.edge[ne++] = ee;
+    }
+    hdr.edge[ne] = NFFT/2;
+    hdr.nout = ne;
+  }
+  else
+    hdr.nout = NFFT/2;
+}
+
+template <int NC, int NB, int NFFT>
+int mLtsa<NC,NB,NFFT>::process(const void *data, int nframes)
+{
+  const uint8_t *src = (const uint8_t *) data;
+  int done = 0;
+  for(int ii = 0; ii < nframes; ii++)
+  { // upper 16 bits of sample
+    x[nx++] = (NB == 16) ? *(const int16_t *) src : (int16_t)(src[1] | (src[2] << 8));
+    src += NC*(NB/8);
+    if(nx == NFFT)
+    { spectrum();
+      nx = 0;
+      if(++nspec == navg) { output(); done = 1; }
+    }
+  }
+  return done;
+}
+
+template <int NC, int NB, int NFFT>
+void mLtsa<NC,NB,NFFT>::spectrum(void)
+{
+  for(int ii = 0; ii < NFFT; ii++)
+  { cbuf[2*ii] = ((int32_t) x[ii]*win[ii] + 0x4000) >> 15;
+    cbuf[2*ii+1] = 0;
+  }
+  arm_cfft_radix4_q15(&fft, cbuf); // output is scaled by 1/NFFT
+  for(int ii = 0; ii < NFFT/2; ii++)
+  { int32_t re = cbuf[2*ii], im = cbuf[2*ii+1];
+    sum[ii] += (float)(uint32_t)(re*re + im*im);
+  }
+}
+
+template <int NC, int NB, int NFFT>
+void mLtsa<NC,NB,NFFT>::output(void)
+{
+  const float scl = (float) NFFT*NFFT/nspec; // mean, undo FFT scaling
+  for(uint32_t kk = 0; kk < hdr.nout; kk++)
+  { float pp = 0;
+    if(!bands)
+      pp = sum[kk];
+    else
+      for(int ii = hdr.edge[kk]; ii < hdr.edge[kk+1]; ii++) pp += sum[ii];
+    pp *= scl;
+    float ll = (pp > 0) ? 1000.0f*log10f(pp) : -32768.0f;
+    rec.level[kk] = (ll > 32767.0f) ? 32767 : (ll < -32768.0f) ? -32768 : (int16_t) ll;
+  }
+  rec.nspec = nspec;
+  memset(sum, 0, sizeof(sum));
+  nspec = 0;
+}
+
+#endif
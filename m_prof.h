@@ -0,0 +1,97 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+ 
+#ifndef M_PROF_H
+#define M_PROF_H
+
+#include "kinetis.h"
+#include "core_pins.h"
+#include <string.h>
+
+// per-stage CPU profile from the DWT cycle counter (DO_PROF>0)
+// stages are bracketed with MP_TIME (statement) or MP_SCOPE (rest of function,
+// also interrupts), idle is the time in wfi; all stages are counted without
+// the interrupt stage (isr) of interrupts that preempted them
+#ifndef DO_PROF
+  #define DO_PROF 0
+#endif
+
+enum { MP_ISR, MP_COPY, MP_DSP, MP_WRITE, MP_IDLE, MP_NSTAGE };
+
+#if DO_PROF>0
+class mProf
+{
+public:
+  mProf(void) { reset(); }
+  void begin(void)
+  { ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+    reset();
+  }
+  void reset(void)
+  { // isr stage is updated by interrupts
+    __disable_irq();
+    for(int ii=0; ii<MP_NSTAGE; ii++)
+    { st[ii].n=0; st[ii].sum=0; st[ii].cmin=0xffffffff; st[ii].cmax=0; }
+    isrCycles=0;
+    t0=micros();
+    __enable_irq();
+  }
+  void add(int k, uint32_t dc)
+  { st[k].n++; st[k].sum += dc;
+    if(dc<st[k].cmin) st[k].cmin=dc;
+    if(dc>st[k].cmax) st[k].cmax=dc;
+    if(k==MP_ISR) isrCycles += dc;
+  }
+  uint32_t isr(void) { return isrCycles; }
+  void add(int k, uint32_t dc, uint32_t i0)
+  { // less interrupt cycles since i0 = isr() at start
+    uint32_t di = isrCycles-i0;
+    add(k, dc>di ? dc-di : 0);
+  }
+  void idle(void)
+  { uint32_t i0 = isrCycles;
+    uint32_t c0 = ARM_DWT_CYCCNT;
+    asm volatile("wfi");
+    add(MP_IDLE, ARM_DWT_CYCCNT-c0, i0);
+  }
+  int sprint(char *txt)
+  { static const char *name[MP_NSTAGE] = {"isr", "copy", "dsp", "write", "idle"};
+    __disable_irq(); // consistent snapshot of isr stage
+    uint64_t tot = (uint64_t)(micros()-t0)*(F_CPU/1000000);
+    stage sn[MP_NSTAGE];
+    memcpy(sn, st, sizeof(sn));
+    __enable_irq();
+    if(!tot) tot=1;
+    int nc = sprintf(txt, "cycles n min mean max; %% of %d MHz\r\n", F_CPU/1000000);
+    for(int ii=0; ii<MP_NSTAGE; ii++)
+    { if(!sn[ii].n) continue;
+      nc += sprintf(txt+nc, " %s: %d %d %d %d; %d.%02d%%\r\n", name[ii], sn[ii].n, sn[ii].cmin,
+                    (uint32_t)(sn[ii].sum/sn[ii].n), sn[ii].cmax,
+                    (uint32_t)(100*sn[ii].sum/tot), (uint32_t)(10000*sn[ii].sum/tot)%100);
+    }
+    return nc;
+  }
+private:
+  struct stage { uint32_t n, cmin, cmax; uint64_t sum; } st[MP_NSTAGE];
+  volatile uint32_t isrCycles; // running total of interrupt stage (wraps)
+  uint32_t t0;
+};
+mProf prof;
+
+struct mProfScope
+{ int k; uint32_t c0, i0;
+  mProfScope(int k) : k(k), c0(ARM_DWT_CYCCNT), i0(prof.isr()) { }
+  ~mProfScope() { prof.add(k, ARM_DWT_CYCCNT-c0, i0); }
+};
+#define MP_TIME(k, x) { uint32_t c0_ = ARM_DWT_CYCCNT, i0_ = prof.isr(); x; prof.add(k, ARM_DWT_CYCCNT-c0_, i0_); }
+#define MP_SCOPE(k) mProfScope mp_scope_(k)
+#define MP_WFI() prof.idle()
+#else
+#define MP_TIME(k, x) { x; }
+#define MP_SCOPE(k)
+#define MP_WFI() asm volatile("wfi")
+#endif
+
+#endif
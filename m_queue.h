@@ -33,38 +33,127 @@
 #define M_QUEUE_H
 
 #include "AudioStream.h"
+#include "m_prof.h"
+
+// head is only written by update() (producer, audio interrupt),
+// tail is only written by the consumer (loop); the queue entries are
+// always written before head and released before tail is advanced
+#define MQ_BARRIER() asm volatile("" ::: "memory")
+
+// statistics on queue usage and lost blocks
+// counters are per file (resetStats), gaps are recorded with their position
+// in the stream of accepted blocks and fetched by the consumer (getGap)
+#define MQ_NGAP 32 // max number of gaps to be kept until fetched
+
+class mQueueStats
+{
+public:
+	mQueueStats(void) : nBlocks(0), nDropped(0), maxRun(0), curRun(0), maxUsage(0),
+		gHead(0), gTail(0), nStream(0), tStream(0) { }
+	uint16_t getMaxUsage(void) { return maxUsage; }
+	uint32_t getDropped(void) { return nDropped; }
+	uint32_t getMaxRun(void) { return maxRun; }
+	uint32_t getBlocks(void) { return nBlocks; }
+	uint32_t getT0(void) { return t0; } // micros() at first accepted block
+	uint32_t getStamp(uint32_t *cyc) // blocks (accepted and lost) and cycle count of last one
+	{ uint32_t n;
+	  do { n = nStream; *cyc = tStream; } while (n != nStream); // producer interrupted
+	  return n;
+	}
+	void resetStats(void) { maxUsage = 0; nDropped = 0; maxRun = 0; }
+	int getGap(uint32_t *pos, uint32_t *len, uint32_t before);
+protected:
+	// new stream (begin): block counts, first block time and pending gaps
+	void resetStream(void) { nBlocks = 0; t0 = 0; nStream = 0; curRun = 0; gTail = gHead; }
+	void blockAccepted(void) { if (!nBlocks) t0 = micros(); nBlocks++; curRun = 0; blockStamp(); }
+	void blockStamp(void) { tStream = ARM_DWT_CYCCNT; nStream++; }
+	void blockDropped(void);
+	void queueUsage(uint16_t n) { if (n > maxUsage) maxUsage = n; }
+private:
+	volatile uint32_t nBlocks;   // accepted blocks since start
+	volatile uint32_t t0;
+	volatile uint32_t nDropped;  // lost blocks
+	volatile uint32_t maxRun;    // longest run of lost blocks
+	uint32_t curRun;
+	volatile uint16_t maxUsage;  // queue high-water mark
+	struct { uint32_t pos, len; } gap[MQ_NGAP];
+	volatile uint16_t gHead, gTail;
+	volatile uint32_t nStream, tStream;
+};
+
+// called by producer (interrupt)
+void mQueueStats::blockDropped(void)
+{
+	nDropped++;
+	blockStamp();
+	if (curRun++ == 0) {
+		// new gap, if there is no space for it, only counters are updated
+		uint16_t h = gHead + 1;
+		if (h >= MQ_NGAP) h = 0;
+		if (h != gTail) {
+			gap[h].pos = nBlocks;
+			gap[h].len = 1;
+			MQ_BARRIER();
+			gHead = h;
+		}
+	} else if (gap[gHead].pos == nBlocks) {
+		gap[gHead].len = curRun;
+	}
+	if (curRun > maxRun) maxRun = curRun;
+}
+
+// called by consumer, returns oldest gap that occurred before block 'before'
+int mQueueStats::getGap(uint32_t *pos, uint32_t *len, uint32_t before)
+{
+	uint16_t t = gTail;
+	if (t == gHead) return 0;
+	if (++t >= MQ_NGAP) t = 0;
+	MQ_BARRIER();
+	if ((int32_t)(gap[t].pos - before) >= 0) return 0;
+	*pos = gap[t].pos;
+	*len = gap[t].len;
+	MQ_BARRIER();
+	gTail = t;
+	return 1;
+}
 
 //#define MQ 53
 template <int MQ>
-class mRecordQueue : public AudioStream
+class mRecordQueue : public AudioStream, public mQueueStats
 {
 public:
 	mRecordQueue(void) : AudioStream(1, inputQueueArray),
-		userblock(NULL), head(0), tail(0), enabled(0) { }
+		userblock(NULL), nbatch(0), head(0), tail(0), enabled(0),
+		leader(NULL), accepted(false) { }
    
-	void begin(void) {  clear();	 enabled = 1;	}
+	void begin(void) {  clear(); resetStream(); enabled = 1;	}
   void end(void) { enabled = 0; }
+	// second channel: drop whenever the queue of the first channel drops, so both
+	// stay aligned (leader must be updated first, i.e. constructed first)
+	void follow(mRecordQueue *q) { leader = q; }
 	int available(void);
 	void clear(void);
 	void * readBuffer(void);
 	void freeBuffer(void);
+	// batch interface: returns all contiguous ready blocks
+	int readBlocks(audio_block_t * volatile **blocks);
+	void freeBlocks(int nb);
 	virtual void update(void);
 private:
 	audio_block_t *inputQueueArray[1];
 	audio_block_t * volatile queue[MQ];
 	audio_block_t *userblock;
+	uint16_t nbatch;
 	volatile uint16_t head, tail, enabled;
-
-  //temp variables
-  uint16_t h, t;
-
+	mRecordQueue *leader;
+	bool accepted; // last block was queued
 };
 
 template <int MQ>
 int mRecordQueue<MQ>::available(void)
 {
-	h = head;
-	t = tail;
+	uint16_t h = head;
+	uint16_t t = tail;
 	if (h >= t) return h - t;
 	return MQ + h - t;
 }
@@ -76,7 +165,8 @@ void mRecordQueue<MQ>::clear(void)
 		release(userblock);
 		userblock = NULL;
 	}
-	t = tail;
+	nbatch = 0;
+	uint16_t t = tail;
 	while (t != head) {
 		if (++t >= MQ) t = 0;
 		release(queue[t]);
@@ -87,11 +177,12 @@ void mRecordQueue<MQ>::clear(void)
 template <int MQ>
 void * mRecordQueue<MQ>::readBuffer(void)
 {
-	if (userblock) return NULL;
-	t = tail;
+	if (userblock || nbatch) return NULL;
+	uint16_t t = tail;
 	if (t == head) return NULL;
 	if (++t >= MQ) t = 0;
 	userblock = queue[t];
+	MQ_BARRIER();
 	tail = t;
 	return (void *) userblock->data;
 }
@@ -104,25 +195,195 @@ void mRecordQueue<MQ>::freeBuffer(void)
 	userblock = NULL;
 }
 
+template <int MQ>
+int mRecordQueue<MQ>::readBlocks(audio_block_t * volatile **blocks)
+{
+	if (userblock || nbatch) return 0;
+	uint16_t h = head;
+	uint16_t t = tail;
+	if (h == t) return 0;
+	MQ_BARRIER();
+	if (++t >= MQ) t = 0;
+	// stop at end of array, remaining blocks are returned by next call
+	nbatch = (h >= t) ? h - t + 1 : MQ - t;
+	*blocks = &queue[t];
+	return nbatch;
+}
+
+template <int MQ>
+void mRecordQueue<MQ>::freeBlocks(int nb)
+{
+	if (nb > nbatch) nb = nbatch;
+	uint16_t t = tail;
+	for (int ii = 0; ii < nb; ii++) {
+		if (++t >= MQ) t = 0;
+		release(queue[t]);
+	}
+	MQ_BARRIER();
+	tail = t;
+	nbatch = 0;
+}
+
 template <int MQ>
 void mRecordQueue<MQ>::update(void)
 {
+	MP_SCOPE(MP_ISR);
 	audio_block_t *block;
 
 	block = receiveReadOnly();
 	if (!block) return;
 	if (!enabled) {
 		release(block);
+		accepted = false;
 		return;
 	}
-	h = head + 1;
+	uint16_t h = head + 1;
 	if (h >= MQ) h = 0;
-	if (h == tail) {
+	uint16_t t = tail;
+	if (h == t || (leader && !leader->accepted)) {
 		release(block);
+		blockDropped();
+		accepted = false;
 	} else {
 		queue[h] = block;
+		MQ_BARRIER();
 		head = h;
+		accepted = true;
+		blockAccepted();
+		queueUsage((h >= t) ? h - t : MQ + h - t);
 	}
 }
 
+// queue of disk buffers
+// acquisition blocks are placed by the producer (I2S interrupt) directly into
+// the disk buffers, so that complete buffers can be written to disk without copy
+// head is the buffer being filled, tail the next buffer to be written
+template <int NB, int NBYTES>
+class mDiskQueue : public mQueueStats
+{
+public:
+	mDiskQueue(void) : head(0), tail(0), enabled(0), wptr(0) { }
+
+	void begin(void) {  clear(); resetStream(); enabled = 1;	}
+	void end(void) { enabled = 0; }
+	int available(void);
+	void clear(void);
+	// consumer interface (one full disk buffer of NBYTES)
+	void * readBuffer(void);
+	void freeBuffer(void);
+	// nn-th full disk buffer (nn < available()) without removing it
+	void * peekBuffer(int nn);
+	// consumer batch interface (all contiguous full disk buffers)
+	int readBuffers(void **buffers);
+	void freeBuffers(int nb);
+	// producer interface (one acquisition block of nbytes)
+	void * getBlock(void);
+	void putBlock(uint32_t nbytes);
+private:
+	uint32_t buffer[NB][NBYTES/4];
+	volatile uint16_t head, tail, enabled;
+	uint32_t wptr; // fill level of buffer[head] in bytes
+
+	bool publish(void);
+};
+
+template <int NB, int NBYTES>
+int mDiskQueue<NB,NBYTES>::available(void)
+{
+	uint16_t h = head;
+	uint16_t t = tail;
+	if (h >= t) return h - t;
+	return NB + h - t;
+}
+
+template <int NB, int NBYTES>
+void mDiskQueue<NB,NBYTES>::clear(void)
+{
+	wptr = 0;
+	tail = head;
+}
+
+template <int NB, int NBYTES>
+void * mDiskQueue<NB,NBYTES>::readBuffer(void)
+{
+	uint16_t t = tail;
+	if (t == head) return NULL;
+	MQ_BARRIER();
+	return (void *) buffer[t];
+}
+
+template <int NB, int NBYTES>
+void mDiskQueue<NB,NBYTES>::freeBuffer(void)
+{
+	uint16_t t = tail;
+	if (t == head) return;
+	if (++t >= NB) t = 0;
+	MQ_BARRIER();
+	tail = t;
+}
+
+template <int NB, int NBYTES>
+void * mDiskQueue<NB,NBYTES>::peekBuffer(int nn)
+{
+	uint16_t t = tail + nn;
+	if (t >= NB) t -= NB;
+	MQ_BARRIER();
+	return (void *) buffer[t];
+}
+
+template <int NB, int NBYTES>
+int mDiskQueue<NB,NBYTES>::readBuffers(void **buffers)
+{
+	uint16_t h = head;
+	uint16_t t = tail;
+	if (t == h) return 0;
+	MQ_BARRIER();
+	*buffers = (void *) buffer[t];
+	// stop at end of array, remaining buffers are returned by next call
+	return (h > t) ? h - t : NB - t;
+}
+
+template <int NB, int NBYTES>
+void mDiskQueue<NB,NBYTES>::freeBuffers(int nb)
+{
+	uint16_t t = tail + nb;
+	if (t >= NB) t -= NB;
+	MQ_BARRIER();
+	tail = t;
+}
+
+template <int NB, int NBYTES>
+bool mDiskQueue<NB,NBYTES>::publish(void)
+{
+	uint16_t h = head + 1;
+	if (h >= NB) h = 0;
+	uint16_t t = tail;
+	if (h == t) return false;
+	MQ_BARRIER();
+	head = h;
+	wptr = 0;
+	queueUsage((h >= t) ? h - t : NB + h - t);
+	return true;
+}
+
+template <int NB, int NBYTES>
+void * mDiskQueue<NB,NBYTES>::getBlock(void)
+{
+	if (!enabled) return NULL;
+	// buffer may be complete but not yet published as queue was full
+	if ((wptr == NBYTES) && !publish()) {
+		blockDropped();
+		return NULL;
+	}
+	return (void *) ((uint8_t *) buffer[head] + wptr);
+}
+
+template <int NB, int NBYTES>
+void mDiskQueue<NB,NBYTES>::putBlock(uint32_t nbytes)
+{
+	wptr += nbytes;
+	blockAccepted();
+	if (wptr == NBYTES) publish(); // buffer complete, hand over to consumer
+}
+
 #endif
@@ -0,0 +1,82 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+#ifndef M_SCHED_H
+#define M_SCHED_H
+
+#include <stdint.h>
+
+// recording schedule
+// duty cycle of dur seconds recording every dur+intv seconds, starting at t0,
+// optionally restricted to daily windows (minutes of day, may wrap over midnight)
+// within a window the duty cycle restarts at window start
+// where windows overlap, the first added window that records wins and
+// periodEnd is only an estimate (it sizes the preallocation)
+// all queries are O(number of windows) from the RTC seconds
+#define MS_NWIN 4
+
+class mSchedule
+{
+public:
+  mSchedule(void) : t0(0), dur(60), per(120), nwin(0) { }
+  void begin(uint32_t start, uint32_t rec_dur, uint32_t rec_int)
+  { t0 = start; dur = rec_dur ? rec_dur : 1; per = dur + rec_int; nwin = 0; }
+  // add daily window [startMin, endMin) in minutes of day (0..1440)
+  int addWindow(uint32_t startMin, uint32_t endMin)
+  { if(nwin >= MS_NWIN || startMin == endMin || startMin >= 1440 || endMin > 1440) return 0;
+    wbeg[nwin] = startMin*60;
+    wlen[nwin] = ((endMin + 1440 - startMin) % 1440)*60;
+    if(wlen[nwin] == 0) wlen[nwin] = 86400;
+    nwin++;
+    return 1;
+  }
+  // seconds until next recording period, 0 if tt is within a recording period
+  uint32_t sleepTime(uint32_t tt) { uint32_t ps, pe; return eval(tt, &ps, &pe); }
+  // start of recording period that contains tt (changes at file rollover)
+  uint32_t periodStart(uint32_t tt) { uint32_t ps = 0, pe; eval(tt, &ps, &pe); return ps; }
+  // end of recording period that contains tt (limited by window end)
+  uint32_t periodEnd(uint32_t tt) { uint32_t ps, pe = tt; eval(tt, &ps, &pe); return pe; }
+
+private:
+  uint32_t t0, dur, per;
+  int nwin;
+  uint32_t wbeg[MS_NWIN], wlen[MS_NWIN]; // window start (s of day) and length (s)
+
+  uint32_t eval(uint32_t tt, uint32_t *ps, uint32_t *pe);
+};
+
+uint32_t mSchedule::eval(uint32_t tt, uint32_t *ps, uint32_t *pe)
+{
+  if(tt < t0) return t0 - tt + eval(t0, ps, pe);
+  if(nwin == 0)
+  { uint32_t ph = (tt - t0) % per;
+    *ps = tt - ph;
+    *pe = *ps + dur;
+    return (ph < dur) ? 0 : per - ph;
+  }
+
+  uint32_t sod = tt % 86400;
+  uint32_t next = 0xffffffff;
+  for(int ii = 0; ii < nwin; ii++)
+  { // start of latest occurrence of window (modulo 2^32 arithmetic)
+    uint32_t ws = tt - sod + wbeg[ii];
+    if(wbeg[ii] > sod) ws -= 86400;
+    uint32_t dt = tt - ws;
+    if(dt < wlen[ii])
+    { uint32_t ph = dt % per;
+      if(ph < dur)
+      { *ps = tt - ph;
+        *pe = (dt - ph + dur < wlen[ii]) ? *ps + dur : ws + wlen[ii];
+        return 0;
+      }
+      if(dt - ph + per < wlen[ii]) // next period within this window
+      { if(per - ph < next) next = per - ph;
+        continue;
+      }
+    }
+    if(ws + 86400 - tt < next) next = ws + 86400 - tt;
+  }
+  return next;
+}
+
+#endif
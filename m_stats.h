@@ -0,0 +1,48 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+#ifndef M_STATS_H
+#define M_STATS_H
+
+#include "core_pins.h"
+
+// log-bucketed latency histogram
+// bin 0 counts zero durations, bin k durations in [2^(k-1), 2^k) us
+// last bin collects everything longer
+#define MH_NBINS 24
+
+class mHist
+{
+public:
+  mHist(void) { reset(); }
+  void reset(void)
+  { n=0; sum=0; dmin=0xffffffff; dmax=0;
+    for(int ii=0; ii<MH_NBINS; ii++) hist[ii]=0;
+  }
+  void add(uint32_t dt)
+  { n++; sum += dt;
+    if(dt<dmin) dmin=dt;
+    if(dt>dmax) dmax=dt;
+    int k = dt ? 32-__builtin_clz(dt) : 0;
+    if(k>=MH_NBINS) k=MH_NBINS-1;
+    hist[k]++;
+  }
+  int sprint(char *txt, const char *name)
+  { if(!n) return sprintf(txt, "%s: 0\r\n", name);
+    int nc = sprintf(txt, "%s: %d %d %d %d;", name, n, dmin, (uint32_t)(sum/n), dmax);
+    int kmax=MH_NBINS-1; while(kmax>0 && !hist[kmax]) kmax--;
+    for(int ii=0; ii<=kmax; ii++) nc += sprintf(txt+nc, " %d", hist[ii]);
+    nc += sprintf(txt+nc, "\r\n");
+    return nc;
+  }
+private:
+  uint32_t n;
+  uint64_t sum;
+  uint32_t dmin, dmax;
+  uint32_t hist[MH_NBINS];
+};
+
+// time the execution of a statement in us into histogram
+#define MH_TIME(h, x) { uint32_t t0_ = micros(); x; (h).add(micros()-t0_); }
+
+#endif
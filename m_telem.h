@@ -0,0 +1,55 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+ 
+#ifndef M_TELEM_H
+#define M_TELEM_H
+
+#include <stdint.h>
+
+// binary telemetry, one record per interval kept in a RAM ring
+// and appended to the card (telem.bin, decoded by tools/telem_decode.cpp)
+// file: "TLM1", record size (uint32), then records (little endian)
+struct mTelemRecord
+{ uint32_t time;     // RTC seconds
+  uint32_t loops;    // loop iterations since last record
+  uint32_t blocks;   // acquisition blocks accepted since start
+  uint32_t dropped;  // blocks lost in current file
+  uint16_t nbuf;     // disk buffers written to current file
+  uint16_t queue;    // queue high-water mark in current file
+  uint16_t audioMem; // max audio blocks in use since last record (copy path)
+  uint16_t vin;      // supply voltage (mV)
+  int16_t  temp;     // temperature (0.01 C)
+  uint16_t flags;    // bit 0: records lost before this one
+};
+
+#define MT_LOST 1
+
+template <int N>
+class mTelem
+{
+public:
+  mTelem(void) : head(0), count(0) { }
+  int available(void) { return count; }
+  mTelemRecord *next(void)
+  { // slot for new record, overwrites oldest if ring is full
+    mTelemRecord *r = &ring[head];
+    if(++head >= N) head = 0;
+    r->flags = 0;
+    if(count < N) count++;
+    else ring[head].flags |= MT_LOST; // new oldest record
+    return r;
+  }
+  int read(mTelemRecord **recs)
+  { // oldest contiguous records
+    int tail = head - count; if(tail < 0) tail += N;
+    *recs = &ring[tail];
+    return (tail + count <= N) ? count : N - tail;
+  }
+  void release(int n) { count -= n; }
+private:
+  mTelemRecord ring[N];
+  int head, count;
+};
+
+#endif
@@ -0,0 +1,53 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+#ifndef M_TRIGGER_H
+#define M_TRIGGER_H
+
+#include <stdint.h>
+
+// event detector for trigger mode
+// per block energy of first differences (high-pass, removes DC and flow noise)
+// of first channel is compared with slowly adapting background energy
+// NC channels, NB bits per sample (16, 24), NS samples per block
+template <int NC, int NB, int NS>
+class mTrigger
+{
+public:
+  mTrigger(void) : thresh(10.0f), alpha(0.001f), bg(0), x1(0), nevent(0) { }
+  void begin(float thr, float navg) { thresh = thr; alpha = 1.0f/navg; bg = 0; nevent = 0; }
+  // check nframes of interleaved data, returns 1 if any block exceeds threshold
+  int detect(const void *data, int nframes);
+  float getBackground(void) { return bg; }
+  uint32_t getEvents(void) { return nevent; }
+private:
+  float thresh, alpha, bg;
+  int32_t x1; // last sample of previous block
+  uint32_t nevent;
+};
+
+template <int NC, int NB, int NS>
+int mTrigger<NC,NB,NS>::detect(const void *data, int nframes)
+{
+  const uint8_t *src = (const uint8_t *) data;
+  int fire = 0;
+  for(int ib = 0; ib < nframes/NS; ib++)
+  { float e = 0;
+    for(int ii = 0; ii < NS; ii++)
+    { // upper 16 bits of sample
+      int32_t x = (NB == 16) ? *(const int16_t *) src : (int16_t)(src[1] | (src[2] << 8));
+      src += NC*(NB/8);
+      float d = x - x1;
+      x1 = x;
+      e += d*d;
+    }
+    e /= NS;
+    if(bg < 1.0f) bg = (e < 1.0f) ? 1.0f : e;
+    if(e > thresh*bg) fire = 1;
+    bg += alpha*(e - bg);
+  }
+  nevent += fire;
+  return fire;
+}
+
+#endif
@@ -27,23 +27,49 @@
  *  init(void);
  *  void exit(void);
  *  void open(char * filename);
+ *  bool preAllocate(uint64_t nbytes); // contiguous, false if not possible
+ *  const char *writeMode(void);
+ *  bool openNext(char * tmpname); // create next file ahead of time, false if not supported
+ *  bool preAllocateNext(uint64_t nbytes);
+ *  bool useNext(char * filename); // rename next file and continue with it
+ *  void removeNext(void);
+ *  int32_t openPool(char * dirname, uint32_t nfiles, uint64_t nbytes); // -1 if not supported
+ *  uint32_t poolLeft(void);
+ *  bool claimPool(char * filename); // rename next pool file and continue with it
  *  void writeHeader(char * header, uint32_t ndat);
+ *  void sync(void); // flush data and directory entry
+ *  void pause(void); // end streaming to card (multi-block write), before any other card access
  *  void close(void);
- *  uint32_t write(uint8_t *buffer, uint32_t nbuf);
+ *  uint32_t write(uint8_t *buffer, uint32_t nbuf); // bytes written, short count closes the file
  *  uint32_t read(uint8_t *buffer, uint32_t nbuf);
+ *  bool openRead(char * filename); // existing file for read (close does not truncate it)
+ *  bool remove(char * filename); // closed file
+ *  uint64_t fileSize(void);
+ * c_uSD<FS> accepts any class with this interface (RAM and host backends in mfs_host.h)
  */
  #define SDo   1 // Stock SD library
  #define SdFS  2 // Greimans SD library
- #define uSDFS 3 // CHaN's SD library (does no work yet)
+ #define uSDFS 3 // CHaN's FatFs (uSDFS library)
+ #define RamFS 4 // RAM disk of mfs_host.h (no card, also host builds)
 // note SdFS may need CHECK_PROGRAMMING set to 1 in SdSpiCard.cpp
 
-#define USE_FS SdFS
+#ifndef USE_FS
+  #define USE_FS SdFS
+#endif
 
-// Preallocate 8MB file.
+#ifndef RAW_WRITE
+  #define RAW_WRITE 0
+#endif
+#if RAW_WRITE>0 && USE_FS!=SdFS
+  #error "raw write needs SdFs"
+#endif
+
+// Preallocate 8MB file, if expected file size is not known
 const uint64_t PRE_ALLOCATE_SIZE = 8ULL << 20;
 
 /************************** File System Interface****************/
 #if USE_FS == SdFS
+#define FS_NAME "SdFs"
 
 #include "mTime.h"
 #include "SdFs.h"
@@ -75,7 +101,72 @@ class c_mFS
 {
   private:
   SdFs sd;
-  FsFile file;
+  FsFile fa, fb;
+  FsFile *file = &fa;  // file being written
+  FsFile *nfile = &fb; // next file, created ahead of time
+  int16_t nextState = 0; // 0: none; 1: open; 2: open and contiguously preallocated
+  uint32_t poolNext = 0, poolSize = 0; // unclaimed pool files poolNext .. poolSize-1
+
+  // pool file names take as many directory entries as the final names
+  // (long name of 14..26 characters), so that renaming reuses freed entries
+  static void poolName(char *name, uint32_t ii) { sprintf(name, "pool_%04d_free.tmp", (int)ii); }
+  void savePool(void)
+  { // position of pool, written at exit (not per file) and checked at start
+    char txt[16];
+    FsFile pf;
+    if(!pf.open("pool.txt", O_CREAT | O_TRUNC | O_RDWR)) return;
+    pf.write(txt, sprintf(txt, "%d\n", (int)poolNext));
+    pf.close();
+  }
+  uint32_t loadPool(void)
+  { char txt[16] = {0}, name[24];
+    FsFile pf;
+    uint32_t nn = poolSize+1;
+    if(pf.open("pool.txt", O_RDONLY))
+    { pf.read(txt, sizeof(txt)-1);
+      pf.close();
+      nn = atoi(txt);
+    }
+    // claimed files (renamed) precede the unclaimed ones
+    auto unclaimed = [&](uint32_t ii) { poolName(name, ii); return sd.exists(name); };
+    if(nn<=poolSize && (nn==poolSize || unclaimed(nn)) && (nn==0 || !unclaimed(nn-1))) return nn;
+    uint32_t lo=0, hi=poolSize; // not saved (power loss): bisection
+    while(lo<hi) { uint32_t mid=(lo+hi)/2; if(unclaimed(mid)) hi=mid; else lo=mid+1; }
+    return lo;
+  }
+
+  bool reading = false; // file opened by openRead
+
+  bool contiguous(void)
+  { if(!file->isContiguous()) return false;
+    #if RAW_WRITE>0
+      // exFAT would need the valid data length updated through the file API
+      // raw data must stay within the file size of the directory entry, as it
+      // is not updated while streaming and close truncates at the end of data
+      uint64_t fsize = file->fileSize();
+      if(sd.fatType()!=FAT_TYPE_EXFAT && fsize>=512 && file->contiguousRange(&rawSector, &rawEnd))
+      { if(rawEnd-rawSector+1 > fsize/512) rawEnd = rawSector + fsize/512 - 1;
+        rawState=1;
+      }
+    #endif
+    return true;
+  }
+
+  #if RAW_WRITE>0
+    // raw mode: data go with one open-ended multi-block write (CMD25) to the
+    // preallocated sectors, directory and FAT are only updated at close
+    int16_t rawState; // 0: file write; 1: contiguous sectors known; 2: streaming
+    uint32_t rawSector, rawEnd; // next and last sector of file
+    uint64_t rawBytes; // bytes written by raw mode
+
+    bool rawStop(void)
+    { // continue with file write at end of raw data
+      if(rawState==2 && !sd.card()->writeStop()) sd.errorHalt("writeStop failed");
+      bool ok = !rawState || file->seek(rawBytes);
+      rawState=0;
+      return ok;
+    }
+  #endif
   
   public:
     void init(void)
@@ -99,6 +190,7 @@ class c_mFS
     
     void exit(void)
     {
+      if(poolSize) savePool();
       delay(100);
       #if defined(__MK20DX256__)
         #define SD_CS 10
@@ -119,43 +211,173 @@ class c_mFS
     
     void open(char * filename)
     {
-      if (!file.open(filename, O_CREAT | O_TRUNC |O_RDWR)) {
+      if (!file->open(filename, O_CREAT | O_TRUNC |O_RDWR)) {
         Serial.println(filename);
         sd.errorHalt("file.open failed");
       }
-      if (!file.preAllocate(PRE_ALLOCATE_SIZE)) {
-        sd.errorHalt("file.preAllocate failed");    
+      reading = false;
+      #if RAW_WRITE>0
+        rawState=0; rawBytes=0;
+      #endif
+    }
+
+    bool preAllocate(uint64_t nbytes)
+    { // SdFs allocates contiguous clusters only
+      return file->preAllocate(nbytes) && contiguous();
+    }
+
+    bool openNext(char * tmpname)
+    {
+      if(nextState) return true;
+      if(!nfile->open(tmpname, O_CREAT | O_TRUNC |O_RDWR)) return false;
+      nextState=1;
+      return true;
+    }
+
+    bool preAllocateNext(uint64_t nbytes)
+    {
+      if(nextState!=1 || !nfile->preAllocate(nbytes) || !nfile->isContiguous()) return false;
+      nextState=2;
+      return true;
+    }
+
+    bool useNext(char * filename)
+    { // rollover is a rename (directory entry only) and a handle swap
+      if(!nextState || !nfile->rename(filename)) return false;
+      FsFile *tmp = file; file = nfile; nfile = tmp;
+      #if RAW_WRITE>0
+        rawState=0; rawBytes=0;
+      #endif
+      if(nextState==2) contiguous();
+      nextState=0;
+      return true;
+    }
+
+    void removeNext(void)
+    {
+      if(nextState && !nfile->remove()) Serial.println("file.remove failed");
+      nextState=0;
+    }
+
+    int32_t openPool(char * dirname, uint32_t nfiles, uint64_t nbytes)
+    { // creates pool if dirname does not exist (delete it on card to prepare again)
+      char name[24];
+      poolNext=0; poolSize=0;
+      if(!sd.exists(dirname))
+      { if(!sd.mkdir(dirname) || !sd.chdir(dirname)) return -1;
+        for(poolSize=0; poolSize<nfiles; poolSize++)
+        { poolName(name, poolSize);
+          if(!file->open(name, O_CREAT | O_TRUNC | O_RDWR)) break;
+          if(!file->preAllocate(nbytes) || !file->isContiguous()) { file->remove(); break; } // card full
+          file->close();
+          #if DO_DEBUG>0
+            if(poolSize%100==0) Serial.println(name);
+          #endif
+        }
+        return poolSize;
       }
+      if(!sd.chdir(dirname)) return -1;
+      poolSize = nfiles;
+      poolNext = loadPool();
+      return poolSize-poolNext;
+    }
+
+    uint32_t poolLeft(void) { return poolSize-poolNext; }
+
+    bool claimPool(char * filename)
+    { // pool file keeps its contiguous clusters (no truncate), close frees the unused rest
+      char name[24];
+      poolName(name, poolNext++);
+      if(!file->open(name, O_RDWR)) return false;
+      if(!file->rename(filename)) { file->close(); return false; }
+      #if RAW_WRITE>0
+        rawState=0; rawBytes=0;
+      #endif
+      contiguous();
+      return true;
+    }
+
+    const char *writeMode(void)
+    {
+      #if RAW_WRITE>0
+        if(rawBytes>0) return "raw";
+      #endif
+      return "file";
+    }
+
+    void pause(void)
+    {
+      #if RAW_WRITE>0
+        // end multi-block write, it is restarted with next data
+        if(rawState==2 && !sd.card()->writeStop()) sd.errorHalt("writeStop failed");
+        if(rawState==2) rawState=1;
+      #endif
     }
 
     void writeHeader(char * header, uint32_t ndat)
     {
-      uint32_t fpos = file.curPosition();
-      file.seek(0);
-      file.write(header,ndat);
-      file.seek(fpos);
+      pause();
+      uint32_t fpos = file->curPosition();
+      file->seek(0);
+      file->write(header,ndat);
+      file->seek(fpos);
       
     }
+    void sync(void) { if(!file->sync()) Serial.println("file.sync failed"); }
     void close(void)
     {
-      if(!file.truncate()) Serial.println("file.truncate failed");
-      if(!file.close()) Serial.println("file.close failed");
+      bool ok = !reading;
+      #if RAW_WRITE>0
+        // truncate at end of raw data, only if position is there (never at 0)
+        if(!rawStop()) { Serial.println("file.seek failed, not truncated"); ok = false; }
+      #endif
+      if(ok && !file->truncate()) Serial.println("file.truncate failed");
+      if(!file->close()) Serial.println("file.close failed");
+      reading = false;
     }
 
     uint32_t write(uint8_t *buffer, uint32_t nbuf)
     {
-      if (nbuf != file.write(buffer, nbuf)) sd.errorHalt("write failed");
+      #if RAW_WRITE>0
+        if(rawState)
+        { uint32_t ns = nbuf/512;
+          // partial sector, end of file or card does not support it: file write
+          if((nbuf%512) || (rawSector+ns-1 > rawEnd) || (rawState==1 && !sd.card()->writeStart(rawSector)))
+          { if(!rawStop()) sd.errorHalt("file.seek failed");
+          }
+          else
+          { rawState=2;
+            for(uint32_t ii=0; ii<ns; ii++)
+              if(!sd.card()->writeData(buffer+ii*512)) sd.errorHalt("writeData failed");
+            rawSector += ns;
+            rawBytes += nbuf;
+            return nbuf;
+          }
+        }
+      #endif
+      if (nbuf != file->write(buffer, nbuf)) sd.errorHalt("write failed");
       return nbuf;
     }
 
     uint32_t read(uint8_t *buffer, uint32_t nbuf)
     {      
-      if ((int)nbuf != file.read(buffer, nbuf)) sd.errorHalt("read failed");
+      if ((int)nbuf != file->read(buffer, nbuf)) sd.errorHalt("read failed");
       return nbuf;
     }
+
+    bool openRead(char * filename)
+    { reading = file->open(filename, O_RDONLY);
+      #if RAW_WRITE>0
+        rawState=0; rawBytes=0;
+      #endif
+      return reading;
+    }
+    uint64_t fileSize(void) { return file->fileSize(); }
+    bool remove(char * filename) { return sd.remove(filename); }
 };
 
 #elif  USE_FS == SDo
+#define FS_NAME "SD"
 #include "mTime.h"
 #include "SPI.h"
 #include "SdFat.h"
@@ -194,8 +416,19 @@ class c_mFS
     void chDir(char * dirname)  { sd.chdir(dirname); }
     
     void open(char * filename) { file = sd.open(filename, FILE_WRITE);  }
+    bool preAllocate(uint64_t nbytes) { return false; }
+    bool openNext(char * tmpname) { return false; }
+    bool preAllocateNext(uint64_t nbytes) { return false; }
+    bool useNext(char * filename) { return false; }
+    void removeNext(void) { }
+    int32_t openPool(char * dirname, uint32_t nfiles, uint64_t nbytes) { return -1; }
+    uint32_t poolLeft(void) { return 0; }
+    bool claimPool(char * filename) { return false; }
+    const char *writeMode(void) { return "file"; }
     void close(void) { file.close(); }
     void exit(void){ }
+    void sync(void) { file.flush(); }
+    void pause(void) { }
 
     void writeHeader(char * header, uint32_t ndat) 
     { 
@@ -207,8 +440,7 @@ class c_mFS
 
     uint32_t write(uint8_t *buffer, uint32_t nbuf)
     {
-      file.write(buffer, nbuf);
-      return nbuf;
+      return file.write(buffer, nbuf);
     }
 
     uint32_t read(uint8_t *buffer, uint32_t nbuf)
@@ -216,9 +448,16 @@ class c_mFS
       if ((int)nbuf != file.read(buffer, nbuf)) {Serial.println("error file read"); while(1) asm("wfi");}
       return nbuf;
     }
+
+    bool openRead(char * filename) { file = sd.open(filename, FILE_READ); return file; }
+    uint64_t fileSize(void) { return file.size(); }
+    bool remove(char * filename) { return sd.remove(filename); }
 };
 
 #elif  USE_FS == uSDFS
+#define FS_NAME "uSDFS"
+// needs FF_USE_EXPAND 1 and FF_FS_RPATH 2 in ffconf.h
+#include "mTime.h"
 #include "ff.h"
 #include "ff_utils.h"
 
@@ -232,12 +471,15 @@ class c_mFS
     FIL fil;        /* File object */
 
     UINT wr;
+    bool reading = false; // file opened by openRead
     
     TCHAR wfilename[80];
   
     /* Stop with dying message */
     void die(char *str, FRESULT rc) 
     { Serial.printf("%s: Failed with rc=%u.\n\r", str, rc); while(1) asm("wfi");}
+
+    TCHAR *wname(char *name) { char2tchar(name, 80, wfilename); return wfilename; }
     
   public:
     void init(void)
@@ -247,11 +489,22 @@ class c_mFS
       #endif
       rc = f_mount (&fatfs, (TCHAR *)_T("1:/"), 0);      /* Mount/Unmount a logical drive */
       if (rc) die((char*)"mount", rc);
+      rc = f_chdrive((TCHAR *)_T("1:/"));  // relative paths are on uSD
+      if (rc) die((char*)"chdrive", rc);
     }
 
     void mkDir(char * dirname)
     {
-      
+      FILINFO fno;
+      if(f_stat(wname(dirname), &fno) != FR_NO_FILE) return;
+      rc = f_mkdir(wfilename);
+      if (rc) die((char*)"mkdir", rc);
+    }
+
+    void chDir(char * dirname)
+    {
+      rc = f_chdir(wname(dirname));
+      if (rc) die((char*)"chdir", rc);
     }
 
     void exit(void)
@@ -261,39 +514,50 @@ class c_mFS
     
     void open(char * filename)
     {
-      char2tchar(filename,80,wfilename);
-      //
-      // check status of file
-      rc =f_stat(wfilename,0);
-      Serial.printf("stat %d %x\n",rc,fil.obj.sclust);
-
-      rc = f_open(&fil, wfilename, FA_WRITE | FA_CREATE_ALWAYS);
-      Serial.printf(" opened %d %x\n\r",rc,fil.obj.sclust);
-      // check if file is Good
+      rc = f_open(&fil, wname(filename), FA_WRITE | FA_READ | FA_CREATE_ALWAYS);
       if(rc == FR_INT_ERR)
-      { // only option is to close file
-        rc = f_close(&fil);
-        if(rc == FR_INVALID_OBJECT)
-        { Serial.println("unlinking file");
-          rc = f_unlink(wfilename);
-          if (rc) die((char*)"unlink", rc);
-        }
-        else
-          die((char*)"close", rc);
-        
+      { // damaged entry (e.g. after power loss): remove file and retry once
+        // (not on FR_DISK_ERR: card failure, the file may be intact)
+        Serial.println("unlinking file");
+        f_unlink(wfilename);
+        rc = f_open(&fil, wfilename, FA_WRITE | FA_READ | FA_CREATE_ALWAYS);
       }
-      // retry open file
-      rc = f_open(&fil, wfilename, FA_WRITE | FA_CREATE_ALWAYS);
       if(rc) die((char*)"open", rc);
     }
+
+    bool preAllocate(uint64_t nbytes)
+    { // contiguous allocation, file size is set to nbytes and truncated at close
+      return f_expand(&fil, nbytes, 1) == FR_OK;
+    }
+
+    const char *writeMode(void) { return "file"; }
+
+    bool openNext(char * tmpname) { return false; } // FatFs cannot rename open files
+    bool preAllocateNext(uint64_t nbytes) { return false; }
+    bool useNext(char * filename) { return false; }
+    void removeNext(void) { }
+    int32_t openPool(char * dirname, uint32_t nfiles, uint64_t nbytes) { return -1; }
+    uint32_t poolLeft(void) { return 0; }
+    bool claimPool(char * filename) { return false; }
     
     void writeHeader(char * header, uint32_t ndat) 
     {
-      
+      FSIZE_t fpos = f_tell(&fil);
+      rc = f_lseek(&fil, 0);
+      if(!rc) rc = f_write(&fil, header, ndat, &wr);
+      if(!rc) rc = f_lseek(&fil, fpos);
+      if (rc) die((char*)"header", rc);
     }
+    void sync(void) { rc = f_sync(&fil); if(rc) die((char*)"sync", rc); }
+    void pause(void) { }
     
     void close(void)
     {
+      if(!reading)
+      { rc = f_truncate(&fil);
+        if (rc) Serial.println("f_truncate failed");
+      }
+      reading = false;
       rc = f_close(&fil);
       if (rc) die((char*)"close", rc);
     }
@@ -304,8 +568,7 @@ class c_mFS
       if (rc== FR_DISK_ERR) // IO error
       { uint32_t usd_error = usd_getError();
         Serial.printf(" write FR_DISK_ERR : %x\n\r",usd_error);
-        // only option is to close file
-        // force closing file
+        // only option is to close file: c_uSD closes it and opens the next one
         return 0;
       }
       else if(rc) die((char*)"write",rc);
@@ -313,8 +576,29 @@ class c_mFS
     }
     
     uint32_t read(uint8_t *buffer, uint32_t nbuf)
-    { return 0;
+    {
+      rc = f_read(&fil, buffer, nbuf, &wr);
+      if (rc) die((char*)"read", rc);
+      return wr;
     }
+
+    bool openRead(char * filename)
+    { reading = f_open(&fil, wname(filename), FA_READ) == FR_OK;
+      return reading;
+    }
+    uint64_t fileSize(void) { return f_size(&fil); }
+    bool remove(char * filename) { return f_unlink(wname(filename)) == FR_OK; }
 };
+
+#elif  USE_FS == RamFS
+#define FS_NAME "RamFS"
+
+#include "mTime.h"
+#include "mfs_host.h"
+
+#ifndef MFS_RAM_FS
+  #define MFS_RAM_FS mFsRam // host builds may add write latencies (mFsReplay<mFsRam>)
+#endif
+typedef MFS_RAM_FS c_mFS;
 #endif
 #endif
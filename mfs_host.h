@@ -0,0 +1,178 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+ 
+#ifndef MFS_HOST_H
+#define MFS_HOST_H
+
+/* storage backends with the c_mFS interface (see mfs.h) to be used as
+ * policy of c_uSD<FS>, e.g. by tools/fs_sim.cpp and tools/app_sim.cpp (host parts need tools/host)
+ *  mFsRam        RAM disk (target and host), data wrap around in given memory
+ *                (USE_FS RamFS: c_mFS of firmware)
+ *  mFsPosix      plain file in current directory (host only)
+ *  mFsReplay<FS> adds write latencies replayed from a measured trace (host only)
+ */
+#include <stdint.h>
+#include <string.h>
+
+#ifndef MFS_RAM_BYTES
+  #if defined(__arm__)
+    #define MFS_RAM_BYTES (32*1024) // RAM disk of default mFsRam
+  #else
+    #define MFS_RAM_BYTES (4 << 20)
+  #endif
+#endif
+
+// optional part of interface: not supported
+class mFsBasic
+{
+  public:
+    void init(void) { }
+    void exit(void) { }
+    void mkDir(char *) { }
+    void chDir(char *) { }
+    const char *writeMode(void) { return "file"; }
+    bool openNext(char *) { return false; }
+    bool preAllocateNext(uint64_t) { return false; }
+    bool useNext(char *) { return false; }
+    void removeNext(void) { }
+    int32_t openPool(char *, uint32_t, uint64_t) { return -1; }
+    uint32_t poolLeft(void) { return 0; }
+    bool claimPool(char *) { return false; }
+    void sync(void) { }
+    void pause(void) { }
+    bool openRead(char *) { return false; }
+    uint64_t fileSize(void) { return 0; }
+    bool remove(char *) { return false; }
+};
+
+class mFsRam : public mFsBasic
+{
+  public:
+    mFsRam(uint8_t *mem, uint32_t size) : mem(mem), size(size), pos(0), nbytes(0) { }
+    mFsRam(void) : mFsRam(defaultMem(), MFS_RAM_BYTES) { } // as c_uSD<mFsRam> (USE_FS RamFS)
+    void open(char *) { pos=0; nbytes=0; }
+    bool preAllocate(uint64_t) { return true; }
+    // next file is the same memory, so that rollover follows the card path
+    bool openNext(char *) { return true; }
+    bool preAllocateNext(uint64_t) { return true; }
+    bool useNext(char *) { pos=0; nbytes=0; return true; }
+    void writeHeader(char * header, uint32_t ndat) { memcpy(mem, header, ndat < size ? ndat : size); }
+    void close(void) { }
+    uint32_t write(uint8_t *buffer, uint32_t nbuf)
+    { for(uint32_t nn=0; nn<nbuf; )
+      { uint32_t nc = (size-pos < nbuf-nn) ? size-pos : nbuf-nn;
+        memcpy(mem+pos, buffer+nn, nc);
+        nn += nc; pos += nc; if(pos==size) pos=0;
+      }
+      nbytes += nbuf;
+      return nbuf;
+    }
+    uint32_t read(uint8_t *buffer, uint32_t nbuf)
+    { // from start of file after openRead
+      uint32_t nr = (pos+nbuf <= nbytes && pos+nbuf <= size) ? nbuf : 0;
+      memcpy(buffer, mem+pos, nr); pos += nr;
+      return nr;
+    }
+    bool openRead(char *) { pos=0; return true; } // file last written (if it fitted)
+    uint64_t fileSize(void) { return nbytes; }
+    bool remove(char *) { nbytes=0; return true; }
+    uint64_t getBytes(void) { return nbytes; } // written to current file
+  private:
+    uint8_t *mem;
+    uint32_t size, pos;
+    uint64_t nbytes;
+    static uint8_t *defaultMem(void) { static uint8_t ram[MFS_RAM_BYTES]; return ram; }
+};
+
+#if !defined(__arm__)
+#include "core_pins.h" // host stand-in (tools/host)
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+class mFsPosix : public mFsBasic
+{
+  public:
+    mFsPosix(void) : fd(-1), reading(false) { }
+    void open(char * filename)
+    { reading = false;
+      fd = ::open(filename, O_CREAT | O_TRUNC | O_RDWR, 0644);
+      if(fd<0) { perror(filename); ::exit(1); }
+    }
+    bool preAllocate(uint64_t nbytes) { return posix_fallocate(fd, 0, nbytes)==0; }
+    void writeHeader(char * header, uint32_t ndat)
+    { if(pwrite(fd, header, ndat, 0) != (ssize_t)ndat) perror("header");
+    }
+    void sync(void) { fsync(fd); }
+    void close(void)
+    { if(!reading && ftruncate(fd, lseek(fd, 0, SEEK_CUR))) perror("truncate");
+      ::close(fd); fd=-1; reading=false;
+    }
+    uint32_t write(uint8_t *buffer, uint32_t nbuf)
+    { if(::write(fd, buffer, nbuf) != (ssize_t)nbuf) { perror("write"); ::exit(1); }
+      return nbuf;
+    }
+    uint32_t read(uint8_t *buffer, uint32_t nbuf)
+    { ssize_t nr = ::read(fd, buffer, nbuf);
+      return nr>0 ? nr : 0;
+    }
+    bool openRead(char * filename) { fd = ::open(filename, O_RDONLY); reading = fd>=0; return reading; }
+    uint64_t fileSize(void) { struct stat st; return fstat(fd, &st) ? 0 : st.st_size; }
+    bool remove(char * filename) { return ::unlink(filename)==0; }
+  private:
+    int fd;
+    bool reading;
+};
+
+// trace: text file with one latency (us) per write, '#' lines are comments,
+// replayed cyclically; open (also of next file) and close latencies are fixed
+// (firmware with WRITE_TRACE>0 writes such traces to trace.txt)
+// the latencies advance the simulated time of host/core_pins.h (micros()),
+// are accumulated in elapsed() and slept if realTime
+template <class FS>
+class mFsReplay : public FS
+{
+  public:
+    template <class... A>
+    mFsReplay(A... args) : FS(args...), next(0), tOpen(0), tClose(0), tlast(0), realTime(false), tsum(0) { }
+    bool load(const char *tracefile, uint32_t openUs, uint32_t closeUs)
+    { FILE *fp = fopen(tracefile, "r");
+      if(!fp) return false;
+      char line[80];
+      while(fgets(line, sizeof(line), fp))
+        if(line[0]!='#') trace.push_back(strtoul(line, 0, 10));
+      fclose(fp);
+      tOpen = openUs; tClose = closeUs;
+      return !trace.empty();
+    }
+    void setRealTime(bool rt) { realTime = rt; }
+    uint64_t elapsed(void) { return tsum; }
+    uint32_t lastLatency(void) { return tlast; }
+
+    void open(char * filename) { FS::open(filename); stall(tOpen); }
+    bool openNext(char * tmpname) { bool ok = FS::openNext(tmpname); if(ok) stall(tOpen); return ok; }
+    void close(void) { FS::close(); stall(tClose); }
+    uint32_t write(uint8_t *buffer, uint32_t nbuf)
+    { uint32_t nw = FS::write(buffer, nbuf);
+      if(!trace.empty()) { stall(trace[next]); if(++next>=trace.size()) next=0; }
+      return nw;
+    }
+  private:
+    std::vector<uint32_t> trace;
+    size_t next;
+    uint32_t tOpen, tClose, tlast;
+    bool realTime;
+    uint64_t tsum;
+    void stall(uint32_t us)
+    { tlast = us; tsum += us; hostAdvance(us); // simulated interrupts run meanwhile
+      if(realTime) std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+};
+#endif
+
+#endif
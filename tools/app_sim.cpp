@@ -0,0 +1,163 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host tool: run the firmware (setup() and loop() of app.cpp) in simulated time
+// with the DO_SWEEP benchmark, so that the whole acquisition path is timed:
+// I2S DMA interrupt, copy or zero copy queue, decimation, trigger, FLAC and
+// file handling of c_uSD on the RAM disk (USE_FS RamFS)
+//
+// g++ -std=gnu++14 -O2 -fpermissive -no-pie -Ihost [-D__MK66FX1M0__ -DF_CPU=96000000
+//     -DMAX_FSI=6 -DNCH=1 -DNBITS=16 -DZERO_COPY=1 -DDECIM=1 -DDO_TRIGGER=0 -DDO_FLAC=0]
+//     -o app_sim app_sim.cpp
+// (-fpermissive: the firmware keeps DMA addresses in 32 bit, -no-pie keeps them below 4 GB)
+//
+// app_sim [options]
+//  -w file.wav I2S input from WAV file (1 or 2 channels, 16 or 24 bit, looped),
+//              otherwise a 1 kHz tone of 0.2 s every 2 s (right 1.5 kHz) at
+//              -6 dBFS over noise at -60 dBFS
+//  -s isf      first fsamps[] index, default 0; all rates up to MAX_FSI follow
+//  -t trace    replay write latencies (us per write, as trace.txt of firmware
+//              with WRITE_TRACE), otherwise writes take no time
+//  -o us -x us open and close latencies for replay, default 20000 and 10000
+//  -k factor   host CPU time of loop() times factor is added to the simulated
+//              time (target slower than host by factor), default 0
+//
+// the I2S DMA of host/DMAChannel.h delivers half buffers at the rate of the I2S
+// dividers set by the firmware, its interrupt and the RTC seconds interrupt run
+// while the simulated time passes: during write latencies, delay() and wfi
+// (when loop() returns without progress). interrupts take no simulated time.
+// the firmware prints for each rate the sustained samples/s, the queue
+// high-water mark of the queue in use and the dropped blocks (sweepReport).
+// exit code 0: all rates simulated
+// e.g. with the 300 ms stalls of stall.trace on the Teensy 3.6 defaults only
+// 2 ch at 192 kHz (ZERO_COPY=0) or 2 ch 24 bit from 96 kHz (ZERO_COPY=1) drop:
+//   app_sim -t stall.trace
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#if !defined(__MK20DX256__) && !defined(__MK64FX512__) && !defined(__MK66FX1M0__)
+  #define __MK66FX1M0__
+#endif
+#define DO_SWEEP 1
+#define USE_FS 4 // RamFS
+#define MFS_RAM_FS mFsReplay<mFsRam>
+
+#include "host/DMAChannel.h"
+#include "../app.cpp"
+
+// I2S input
+static std::vector<int32_t> wav; // interleaved, left justified 32 bit
+static int wavNch = 0;
+static size_t wavPos = 0;
+static uint64_t nframe = 0;
+static uint32_t rnd = 12345;
+
+static void wavSource(uint32_t *slots, int nf)
+{ for(int ii=0; ii<nf; ii++)
+  { if(wavPos >= wav.size()) wavPos = 0;
+    slots[2*ii] = wav[wavPos];
+    slots[2*ii+1] = wav[wavPos + wavNch-1];
+    wavPos += wavNch;
+  }
+}
+
+static void synthSource(uint32_t *slots, int nf)
+{ double fs = hostI2SRate();
+  for(int ii=0; ii<nf; ii++, nframe++)
+  { double t = nframe/fs;
+    bool on = fmod(t, 2.0) < 0.2;
+    for(int ic=0; ic<2; ic++)
+    { rnd = rnd*1664525 + 1013904223;
+      double v = ((int32_t)rnd)*0.001; // -60 dBFS
+      if(on) v += 0.5*2147483647.0*sin(2*M_PI*(1000.0 + 500*ic)*t);
+      slots[2*ii+ic] = (uint32_t)(int32_t)v;
+    }
+  }
+}
+
+static uint32_t rd32(const uint8_t *p) { return p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24; }
+static uint16_t rd16(const uint8_t *p) { return p[0] | p[1]<<8; }
+
+static bool loadWav(const char *name)
+{ FILE *fd = fopen(name, "rb");
+  if(!fd) return false;
+  std::vector<uint8_t> w;
+  uint8_t tmp[65536];
+  size_t nr;
+  while((nr = fread(tmp, 1, sizeof(tmp), fd)) > 0) w.insert(w.end(), tmp, tmp + nr);
+  fclose(fd);
+  if(w.size() < 12 || memcmp(&w[0], "RIFF", 4) || memcmp(&w[8], "WAVE", 4)) return false;
+  int nbits = 0;
+  for(size_t p = 12; p + 8 <= w.size(); )
+  { uint32_t len = rd32(&w[p+4]);
+    if(!memcmp(&w[p], "fmt ", 4) && p + 24 <= w.size())
+    { wavNch = rd16(&w[p+10]); nbits = rd16(&w[p+22]); }
+    else if(!memcmp(&w[p], "data", 4))
+    { if((wavNch != 1 && wavNch != 2) || (nbits != 16 && nbits != 24)) return false;
+      size_t n = w.size() - p - 8;
+      if(len > 0 && len < n) n = len;
+      int nb = nbits/8;
+      for(size_t ii = 0; ii + nb <= n; ii += nb)
+      { const uint8_t *s = &w[p + 8 + ii];
+        wav.push_back(nb == 2 ? (s[0] << 16 | s[1] << 24) : (s[0] << 8 | s[1] << 16 | s[2] << 24));
+      }
+      wav.resize(wav.size() - wav.size() % wavNch);
+      return !wav.empty();
+    }
+    p += 8 + len + (len & 1);
+  }
+  return false;
+}
+
+int main(int argc, char **argv)
+{
+  const char *wavFile = 0, *trace = 0;
+  uint32_t topen = 20000, tclose = 10000;
+  double kcpu = 0;
+  int isf0 = 0, opt;
+  while((opt = getopt(argc, argv, "w:s:t:o:x:k:")) != -1)
+  { switch(opt)
+    { case 'w': wavFile = optarg; break;
+      case 's': isf0 = atoi(optarg); break;
+      case 't': trace = optarg; break;
+      case 'o': topen = atoi(optarg); break;
+      case 'x': tclose = atoi(optarg); break;
+      case 'k': kcpu = atof(optarg); break;
+      default: fprintf(stderr, "see header of app_sim.cpp for options\n"); return 1;
+    }
+  }
+  if(isf0 < 0 || isf0 > MAX_FSI) { fprintf(stderr, "-s 0..%d\n", MAX_FSI); return 1; }
+  if(wavFile && !loadWav(wavFile)) { fprintf(stderr, "%s: no 1 or 2 channel 16 or 24 bit WAV\n", wavFile); return 1; }
+  hostI2SSource = wavFile ? wavSource : synthSource;
+  if(trace && !uSD.backend().load(trace, topen, tclose)) { fprintf(stderr, "%s: no trace\n", trace); return 1; }
+
+  // settings as stored by the menu (display.h): continuous, first rate
+  for(int ii=0; ii<13; ii++) EEPROM.write(ii, 0);
+  EEPROM.write(13, isf0);
+
+  printf("app_sim: %d ch, %d bit, ZERO_COPY %d, DECIM %d, DO_TRIGGER %d, DO_FLAC %d, F_CPU %d\n",
+         NCH, NBITS, ZERO_COPY, DECIM, DO_TRIGGER, DO_FLAC, F_CPU);
+  setup();
+  int last = isf, nrates = MAX_FSI + 1 - isf0;
+  while(nrates > 0)
+  { uint64_t t0 = hostMicros;
+    int nav = queue1.available();
+    auto h0 = std::chrono::steady_clock::now();
+    loop();
+    if(kcpu > 0)
+      hostAdvance((uint64_t)(kcpu*std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - h0).count()));
+    // nothing done: firmware waits for the next interrupt
+    if(hostMicros == t0 && queue1.available() == nav && !hostWait())
+    { fprintf(stderr, "app_sim: no interrupt pending\n"); return 1; }
+    if(isf != last) { last = isf; nrates--; }
+  }
+  printf("app_sim: %.1f s simulated\n", hostMicros*1e-6);
+  return 0;
+}
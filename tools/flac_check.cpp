@@ -0,0 +1,347 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host check: FLAC encoder of the logger (m_flac.h) against its own decoder
+//
+// g++ -std=c++14 -O2 [-DFLAC_BLOCK=1024 -DDBUF_BYTES=16384] -o flac_check flac_check.cpp
+//
+// flac_check [-w] [file.wav ...]
+//  -w          also write file.wav.flac (file header written at close, as by
+//              the firmware), e.g. to test it with 'flac -t'
+// without files a synthetic set is checked: 1 and 2 channels, 16 and 24 bit,
+// sine, noise, constant, alternating full scale and a short tail frame.
+// the samples are encoded in disk buffers of DBUF_BYTES as in c_uSD::write,
+// decoded again (CRC8 and CRC16 of every frame, STREAMINFO totals) and
+// compared sample by sample. prints compression ratio and host encode time per
+// sample; cycles on the target are printed by the firmware with DO_BENCH.
+// exit code 0: all bit exact
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifndef FLAC_BLOCK
+  #define FLAC_BLOCK 1024
+#endif
+#ifndef DBUF_BYTES
+  #define DBUF_BYTES 16384
+#endif
+
+#include "../m_flac.h"
+
+// big-endian bit reader
+struct BitReader
+{ const uint8_t *buf;
+  size_t len, pos; // pos in bits
+  bool err;
+  BitReader(const uint8_t *b, size_t n) : buf(b), len(n), pos(0), err(false) {}
+  uint32_t get(int n)
+  { uint32_t v = 0;
+    if(pos + n > 8*len) { err = true; pos = 8*len; return 0; }
+    for(; n > 0; n--, pos++) v = (v << 1) | ((buf[pos >> 3] >> (7 - (pos & 7))) & 1);
+    return v;
+  }
+  int32_t sget(int n) { if(n == 0) return 0; uint32_t v = get(n); return (int32_t)(v << (32-n)) >> (32-n); }
+  uint32_t unary(void) { uint32_t q = 0; while(!err && !get(1)) q++; return q; }
+  void align(void) { pos = (pos + 7) & ~(size_t)7; }
+  size_t byte(void) { return pos >> 3; }
+};
+
+struct StreamInfo { uint32_t minBlk, maxBlk, minFrame, maxFrame, fs; int nch, bps; uint64_t nsamp; };
+
+static bool decodeSubframe(BitReader &br, int32_t *x, uint32_t n, int bps)
+{
+  if(br.get(1)) return false;
+  uint32_t type = br.get(6);
+  int wasted = 0;
+  if(br.get(1)) wasted = br.unary() + 1;
+  bps -= wasted;
+  if(type == 0) { int32_t v = br.sget(bps); for(uint32_t ii = 0; ii < n; ii++) x[ii] = v; }
+  else if(type == 1) { for(uint32_t ii = 0; ii < n; ii++) x[ii] = br.sget(bps); }
+  else if(type >= 8 && type <= 12)
+  { uint32_t order = type - 8;
+    if(order > n) return false;
+    for(uint32_t ii = 0; ii < order; ii++) x[ii] = br.sget(bps);
+    uint32_t method = br.get(2);
+    if(method > 1) return false;
+    int pbits = method ? 5 : 4;
+    uint32_t esc = (1u << pbits) - 1;
+    uint32_t po = br.get(4);
+    uint32_t m = n >> po;
+    if((m << po) != n || m < order) return false;
+    for(uint32_t jj = 0, ii = order; jj < (1u << po); jj++)
+    { uint32_t k = br.get(pbits);
+      if(k == esc)
+      { int nb = br.get(5);
+        for(; ii < (jj+1)*m; ii++) x[ii] = br.sget(nb);
+      }
+      else
+        for(; ii < (jj+1)*m; ii++)
+        { uint32_t u = (br.unary() << k) | br.get(k);
+          x[ii] = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+        }
+    }
+    for(uint32_t ii = order; ii < n; ii++)
+    { int64_t p = 0;
+      switch(order)
+      { case 1: p = x[ii-1]; break;
+        case 2: p = 2*(int64_t)x[ii-1] - x[ii-2]; break;
+        case 3: p = 3*((int64_t)x[ii-1] - x[ii-2]) + x[ii-3]; break;
+        case 4: p = 4*((int64_t)x[ii-1] + x[ii-3]) - 6*(int64_t)x[ii-2] - x[ii-4]; break;
+      }
+      x[ii] += (int32_t) p;
+    }
+  }
+  else return false; // LPC is not produced by the encoder
+  if(wasted) for(uint32_t ii = 0; ii < n; ii++) x[ii] <<= wasted;
+  return !br.err;
+}
+
+// decode stream into interleaved samples, false with message on format error
+static bool decode(const std::vector<uint8_t> &f, StreamInfo &si, std::vector<int32_t> &out, std::string &msg)
+{
+  if(f.size() < 8 || memcmp(f.data(), "fLaC", 4)) { msg = "no fLaC"; return false; }
+  size_t p = 4;
+  bool last = false;
+  bool haveInfo = false;
+  while(!last)
+  { if(p + 4 > f.size()) { msg = "metadata truncated"; return false; }
+    last = f[p] & 0x80;
+    uint32_t type = f[p] & 0x7f, len = f[p+1] << 16 | f[p+2] << 8 | f[p+3];
+    p += 4;
+    if(p + len > f.size()) { msg = "metadata truncated"; return false; }
+    if(type == 0)
+    { BitReader br(&f[p], len);
+      si.minBlk = br.get(16); si.maxBlk = br.get(16);
+      si.minFrame = br.get(24); si.maxFrame = br.get(24);
+      si.fs = br.get(20); si.nch = br.get(3) + 1; si.bps = br.get(5) + 1;
+      si.nsamp = (uint64_t) br.get(4) << 32; si.nsamp |= br.get(32);
+      haveInfo = true;
+    }
+    p += len;
+  }
+  if(!haveInfo) { msg = "no STREAMINFO"; return false; }
+
+  uint64_t next = 0;
+  uint32_t minFrame = 0xffffff, maxFrame = 0, minBlk = 0xffff, nframe = 0;
+  std::vector<int32_t> ch[8];
+  for(int ic = 0; ic < si.nch; ic++) ch[ic].resize(65536);
+  while(p < f.size())
+  { char err[80];
+    BitReader br(&f[p], f.size() - p);
+    if(br.get(15) != 0x7ffc) { sprintf(err, "frame %u: no sync", nframe); msg = err; return false; }
+    bool variable = br.get(1);
+    uint32_t bsCode = br.get(4), fsCode = br.get(4), chCode = br.get(4), ssCode = br.get(3);
+    br.get(1);
+    uint64_t num = br.get(8);
+    if(num & 0x80)
+    { int nc = 0;
+      while(num & (0x80 >> nc)) nc++;
+      num &= 0xff >> (nc+1);
+      for(int ii = 1; ii < nc; ii++) num = (num << 6) | (br.get(8) & 0x3f);
+    }
+    uint32_t bs = 0;
+    if(bsCode == 1) bs = 192;
+    else if(bsCode >= 2 && bsCode <= 5) bs = 576 << (bsCode - 2);
+    else if(bsCode == 6) bs = br.get(8) + 1;
+    else if(bsCode == 7) bs = br.get(16) + 1;
+    else if(bsCode >= 8) bs = 256 << (bsCode - 8);
+    if(fsCode == 12) br.get(8); else if(fsCode == 13 || fsCode == 14) br.get(16);
+    static const int ssBits[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+    int bps = ssCode ? ssBits[ssCode] : si.bps;
+    uint8_t crc8 = 0;
+    for(size_t ii = 0; ii < br.byte(); ii++) crc8 = mf_crc8[crc8 ^ f[p+ii]];
+    if(br.get(8) != crc8) { sprintf(err, "frame %u: header CRC", nframe); msg = err; return false; }
+    if(bs == 0 || bps != si.bps) { sprintf(err, "frame %u: bad header", nframe); msg = err; return false; }
+    if(num != (variable ? next : (uint64_t) nframe * si.maxBlk)) { sprintf(err, "frame %u: sample number", nframe); msg = err; return false; }
+
+    int nch = (chCode < 8) ? chCode + 1 : 2;
+    if(nch != si.nch || chCode > 10) { sprintf(err, "frame %u: channels", nframe); msg = err; return false; }
+    for(int ic = 0; ic < nch; ic++)
+    { int side = (chCode == 8 && ic == 1) || (chCode == 9 && ic == 0) || (chCode == 10 && ic == 1);
+      if(!decodeSubframe(br, ch[ic].data(), bs, bps + side))
+      { sprintf(err, "frame %u channel %d: bad subframe", nframe, ic); msg = err; return false; }
+    }
+    for(uint32_t ii = 0; ii < bs; ii++)
+    { if(chCode == 8) ch[1][ii] = ch[0][ii] - ch[1][ii];
+      else if(chCode == 9) ch[0][ii] += ch[1][ii];
+      else if(chCode == 10)
+      { int32_t mid = (ch[0][ii] << 1) | (ch[1][ii] & 1), side = ch[1][ii];
+        ch[0][ii] = (mid + side) >> 1; ch[1][ii] = (mid - side) >> 1;
+      }
+    }
+    br.align();
+    uint16_t crc16 = 0;
+    for(size_t ii = 0; ii < br.byte(); ii++) crc16 = (crc16 << 8) ^ mf_crc16[(crc16 >> 8) ^ f[p+ii]];
+    if(br.get(16) != crc16) { sprintf(err, "frame %u: frame CRC", nframe); msg = err; return false; }
+
+    for(uint32_t ii = 0; ii < bs; ii++)
+      for(int ic = 0; ic < nch; ic++) out.push_back(ch[ic][ii]);
+    uint32_t nb = br.byte();
+    if(nb < minFrame) minFrame = nb;
+    if(nb > maxFrame) maxFrame = nb;
+    if(bs < minBlk) minBlk = bs;
+    next += bs; nframe++;
+    p += nb;
+  }
+  if(next != si.nsamp) { msg = "STREAMINFO sample count"; return false; }
+  if(nframe && (minFrame != si.minFrame || maxFrame != si.maxFrame || minBlk != si.minBlk))
+  { msg = "STREAMINFO frame sizes"; return false; }
+  return true;
+}
+
+// encode data (interleaved little endian) in disk buffers, decode and compare
+template <int NC, int NB>
+static bool check(const char *name, const std::vector<uint8_t> &data, uint32_t fs, const char *wname)
+{
+  static mFlacEncoder<NC,NB,FLAC_BLOCK> flac;
+  const uint32_t dbuf = (NB == 16) ? DBUF_BYTES : (DBUF_BYTES/(3*512))*(3*512); // as app.cpp
+  const uint32_t fbytes = NC*NB/8;
+  static uint8_t buf[DBUF_BYTES + (DBUF_BYTES/FLAC_BLOCK+1)*MF_OVERHEAD];
+
+  std::vector<uint8_t> f(MF_HDR);
+  flac.begin(fs);
+  sprintf(flac.info(), "flac_check %s", name);
+  double tenc = 0;
+  for(size_t pos = 0; pos < data.size(); pos += dbuf)
+  { uint32_t nd = (data.size() - pos < dbuf) ? data.size() - pos : dbuf;
+    auto t0 = std::chrono::steady_clock::now();
+    uint32_t nc = flac.encode(buf, &data[pos], nd/fbytes);
+    tenc += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    f.insert(f.end(), buf, buf + nc);
+  }
+  memcpy(f.data(), flac.header(), MF_HDR);
+
+  uint64_t nframes = data.size()/fbytes;
+  StreamInfo si;
+  std::vector<int32_t> out;
+  std::string msg;
+  bool ok = decode(f, si, out, msg);
+  if(ok && (si.nch != NC || si.bps != NB || si.fs != fs || si.maxBlk != FLAC_BLOCK)) { ok = false; msg = "STREAMINFO format"; }
+  if(ok && out.size() != nframes*NC) { ok = false; msg = "sample count"; }
+  for(uint64_t ii = 0; ok && ii < nframes*NC; ii++)
+  { const uint8_t *s = &data[ii*(NB/8)];
+    int32_t v = (NB == 16) ? (int16_t)(s[0] | s[1] << 8) : ((int32_t)(s[0] << 8 | s[1] << 16 | s[2] << 24)) >> 8;
+    if(v != out[ii])
+    { char err[80];
+      sprintf(err, "sample %llu channel %d: %d decoded as %d", (unsigned long long)(ii/NC), (int)(ii%NC), v, out[ii]);
+      ok = false; msg = err;
+    }
+  }
+  printf("%-24s %d ch %d bit %9llu samples: %s, ratio %5.3f, %6.1f ns/sample\n", name, NC, NB,
+         (unsigned long long) nframes, ok ? "ok" : msg.c_str(),
+         data.size() ? (double) f.size()/data.size() : 0.0, nframes ? 1e9*tenc/(nframes*NC) : 0.0);
+
+  if(wname)
+  { FILE *fd = fopen(wname, "wb");
+    if(!fd || fwrite(f.data(), 1, f.size(), fd) != f.size()) { fprintf(stderr, "%s: cannot write\n", wname); ok = false; }
+    if(fd) fclose(fd);
+  }
+  return ok;
+}
+
+static bool dispatch(const char *name, int nch, int nbits, const std::vector<uint8_t> &data, uint32_t fs, const char *wname)
+{
+  if(nch == 1 && nbits == 16) return check<1,16>(name, data, fs, wname);
+  if(nch == 2 && nbits == 16) return check<2,16>(name, data, fs, wname);
+  if(nch == 1 && nbits == 24) return check<1,24>(name, data, fs, wname);
+  if(nch == 2 && nbits == 24) return check<2,24>(name, data, fs, wname);
+  fprintf(stderr, "%s: %d ch %d bit not supported (1, 2 ch; 16, 24 bit)\n", name, nch, nbits);
+  return false;
+}
+
+static uint32_t rd32(const uint8_t *p) { return p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24; }
+static uint16_t rd16(const uint8_t *p) { return p[0] | p[1]<<8; }
+
+// PCM WAV (also recorder files not closed, data length 0 or beyond end of file)
+static bool checkWav(const char *name, bool write)
+{
+  FILE *fd = fopen(name, "rb");
+  if(!fd) { fprintf(stderr, "%s: cannot open\n", name); return false; }
+  std::vector<uint8_t> w;
+  uint8_t tmp[65536];
+  size_t nr;
+  while((nr = fread(tmp, 1, sizeof(tmp), fd)) > 0) w.insert(w.end(), tmp, tmp + nr);
+  fclose(fd);
+  if(w.size() < 12 || memcmp(&w[0], "RIFF", 4) || memcmp(&w[8], "WAVE", 4)) { fprintf(stderr, "%s: no WAV\n", name); return false; }
+
+  int nch = 0, nbits = 0;
+  uint32_t fs = 0;
+  for(size_t p = 12; p + 8 <= w.size(); )
+  { uint32_t len = rd32(&w[p+4]);
+    if(!memcmp(&w[p], "fmt ", 4) && p + 24 <= w.size())
+    { uint16_t tag = rd16(&w[p+8]);
+      nch = rd16(&w[p+10]); fs = rd32(&w[p+12]); nbits = rd16(&w[p+22]);
+      if(tag != 1 && tag != 0xfffe) { fprintf(stderr, "%s: not PCM\n", name); return false; }
+    }
+    else if(!memcmp(&w[p], "data", 4))
+    { if(!nch) break;
+      size_t n = w.size() - p - 8;
+      if(len > 0 && len < n) n = len;
+      n -= n % (nch*nbits/8);
+      std::vector<uint8_t> data(w.begin() + p + 8, w.begin() + p + 8 + n);
+      std::string out = std::string(name) + ".flac";
+      return dispatch(name, nch, nbits, data, fs, write ? out.c_str() : 0);
+    }
+    p += 8 + len + (len & 1);
+  }
+  fprintf(stderr, "%s: no fmt or data chunk\n", name);
+  return false;
+}
+
+static uint32_t rnd = 12345;
+static int32_t noise(int nbits) { rnd = rnd*1664525 + 1013904223; return (int32_t) rnd >> (32 - nbits); }
+
+// synthetic signals, frames is not a multiple of FLAC_BLOCK
+static bool checkSynthetic(int nch, int nbits)
+{
+  const uint32_t fs = 48000;
+  const uint32_t nframes = 8*FLAC_BLOCK + 100;
+  const int32_t vmax = (1 << (nbits-1)) - 1, vmin = -vmax - 1;
+  static const char *names[] = {"sine", "noise", "constant", "alternating", "tail 7 samples", "clipped sine"};
+  bool ok = true;
+  for(int is = 0; is < 6; is++)
+  { uint32_t nf = (is == 4) ? 2*FLAC_BLOCK + 7 : nframes;
+    std::vector<uint8_t> data(nf*nch*nbits/8);
+    uint8_t *p = data.data();
+    for(uint32_t ii = 0; ii < nf; ii++)
+      for(int ic = 0; ic < nch; ic++)
+      { double s = sin(2*M_PI*(1000.0 + 500*ic)*ii/fs);
+        int32_t v = 0;
+        switch(is)
+        { case 0: v = (int32_t)(0.5*vmax*s) + noise(nbits-12); break;
+          case 1: v = noise(nbits); break;
+          case 2: v = (ic ? vmin : 1234); break;
+          case 3: v = (ii & 1) ? vmax : vmin; break;
+          case 4: v = (int32_t)(0.25*vmax*s); break;
+          case 5: v = (s > 0.5) ? vmax : (s < -0.5) ? vmin : (int32_t)(2*vmax*s); break;
+        }
+        for(int ib = 0; ib < nbits/8; ib++) *p++ = v >> (8*ib);
+      }
+    ok &= dispatch(names[is], nch, nbits, data, fs, 0);
+  }
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  bool write = false, ok = true;
+  int ia = 1;
+  for(; ia < argc && argv[ia][0] == '-'; ia++)
+  { if(!strcmp(argv[ia], "-w")) write = true;
+    else { fprintf(stderr, "usage: flac_check [-w] [file.wav ...]\n"); return 1; }
+  }
+  if(ia == argc)
+  { for(int nb = 16; nb <= 24; nb += 8)
+      for(int nc = 1; nc <= 2; nc++) ok &= checkSynthetic(nc, nb);
+  }
+  for(; ia < argc; ia++) ok &= checkWav(argv[ia], write);
+  printf("%s\n", ok ? "all bit exact" : "MISMATCH");
+  return ok ? 0 : 1;
+}
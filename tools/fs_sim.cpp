@@ -0,0 +1,173 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host tool: run the logger's disk buffering (mDiskQueue) and file handling
+// (c_uSD) against a storage backend in simulated time
+//
+// g++ -std=c++14 -O2 -Ihost [-DNDBUF=12 -DDBUF_BYTES=16384] -o fs_sim fs_sim.cpp
+//
+// fs_sim [options]
+//  -r rates    sampling rate (Hz) or comma separated list, simulated one after
+//              the other as the DO_SWEEP benchmark of the firmware, default 192000
+//  -c nch      channels, default 1
+//  -s bytes    bytes per sample, default 2
+//  -f sec      seconds per file (rollover at multiples of RTC seconds), default 60
+//  -d sec      simulated recording time, default 3600
+//  -p          write to plain files (./hh_mm_ss.wav) instead of RAM disk
+//  -t trace    replay write latencies (us per write, one per line, as trace.txt
+//              of firmware with WRITE_TRACE) from trace, otherwise the measured
+//              host latency of the backend is used
+//  -o us -x us open and close latencies for replay, default 20000 and 10000
+//  -v          print c_uSD log (latency histograms per file)
+//
+// audio blocks of 128 frames arrive at their time and are put into the disk
+// buffers with getBlock/putBlock, as by the I2S interrupt; blocks that arrive
+// while c_uSD writes are produced before the written buffers are freed.
+// exit code is 2 if blocks were lost, so it can be used as regression test,
+// e.g. 7199 rollovers (next file created in idle) with stalls of 300 ms:
+//   fs_sim -t stall.trace -f 1 -d 7200  (scripted in rollover_check.sh)
+// the whole acquisition path of the firmware (copy, decimation, trigger, FLAC)
+// is simulated by app_sim.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+
+#ifndef NDBUF
+  #define NDBUF 12
+#endif
+#ifndef DBUF_BYTES
+  #define DBUF_BYTES 16384
+#endif
+#define ZERO_COPY 1
+#define USE_FS 4 // RamFS
+#define CHECKPOINT_S 10
+
+#include "../m_queue.h"
+#include "../logger_if.h"
+
+static uint32_t rate = 192000, fileSec = 60;
+static int nch = 1, nbs = 2;
+static bool verbose = false;
+static uint32_t nClosed = 0;
+static char header[512];
+
+// application interface of logger_if.h: continuous recording, rollover per period
+uint32_t record_or_sleep(void) { return 0; }
+uint32_t record_period(void) { return RTC_TSR/fileSec; }
+uint64_t expectedFileSize(uint32_t) { return 512 + (uint64_t)fileSec*rate*nch*nbs + DBUF_BYTES; }
+uint64_t nextFileSize(int) { return expectedFileSize(RTC_TSR); }
+uint64_t poolFileSize(void) { return expectedFileSize(RTC_TSR); }
+char * headerUpdate(void) { return header; }
+char * headerClose(uint32_t) { nClosed++; return header; }
+char * headerCheck(uint32_t) { return header; }
+void appendLog(const char *text) { if(verbose) fputs(text, stdout); }
+void appendFile(const char *, const void *, uint32_t, const void *, uint32_t) { }
+
+static mDiskQueue<NDBUF, DBUF_BYTES> queue;
+
+static double now_us(void)
+{ return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <class FS>
+int simulate(c_uSD<FS> &uSD, bool measure, double totSec)
+{
+  const uint32_t blkBytes = 128*nch*nbs;
+  const uint64_t nblk = (uint64_t)(totSec*rate/128);
+  uint64_t ib = 0, nwrites = 0;
+  double wmax = 0, wsum = 0;
+  auto arrival = [&](uint64_t n) { return n*128000000ULL/rate; };
+  auto produce = [&]()
+  { // blocks arrived until now
+    while(ib<nblk && arrival(ib)<=hostMicros)
+    { if(queue.getBlock()) queue.putBlock(blkBytes);
+      ib++;
+    }
+  };
+  // backend call in simulated time: replayed latencies advance it already,
+  // otherwise the host time of the call is added
+  auto run = [&](auto f)
+  { uint64_t t0 = hostMicros;
+    double h0 = now_us();
+    f();
+    if(measure) hostMicros += (uint64_t)(now_us()-h0);
+    return (double)(hostMicros-t0);
+  };
+
+  hostMicros = 0;
+  nClosed = 0;
+  queue.resetStats();
+  queue.begin();
+  uSD.init();
+  uSD.chDir();
+  while(ib<nblk)
+  { void *buffer;
+    int nbuf = queue.readBuffers(&buffer);
+    if(nbuf>0)
+    { double dt = run([&]{ uSD.write((uint8_t *)buffer, nbuf*DBUF_BYTES); });
+      nwrites++; wsum += dt; if(dt>wmax) wmax = dt;
+      produce();
+      queue.freeBuffers(nbuf);
+    }
+    else
+    { run([&]{ uSD.idle(); });
+      produce();
+      if(!queue.available() && ib<nblk && arrival(ib)>hostMicros) hostMicros = arrival(ib); // wfi
+      produce();
+    }
+  }
+  queue.end();
+  uint32_t nfiles = nClosed;
+  uSD.setClosing();
+  uSD.write(0, 0); // close last file
+
+  printf("%d Hz x %d ch x %d bytes, %d buffers of %d bytes, %d s per file\n",
+         rate, nch, nbs, NDBUF, DBUF_BYTES, fileSec);
+  printf("blocks %llu, dropped %d; rollovers %d; queue max %d of %d; write mean %.0f us, max %.0f us\n",
+         (unsigned long long)nblk, queue.getDropped(), nfiles,
+         queue.getMaxUsage(), NDBUF-1, nwrites ? wsum/nwrites : 0.0, wmax);
+  return queue.getDropped() ? 2 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t topen = 20000, tclose = 10000;
+  const char *rates = "192000";
+  int opt;
+  double totSec = 3600;
+  bool posix = false;
+  const char *trace = 0;
+  while((opt = getopt(argc, argv, "r:c:s:f:d:pt:o:x:v")) != -1)
+  { switch(opt)
+    { case 'r': rates = optarg; break;
+      case 'c': nch = atoi(optarg); break;
+      case 's': nbs = atoi(optarg); break;
+      case 'f': fileSec = atoi(optarg); break;
+      case 'd': totSec = atof(optarg); break;
+      case 'p': posix = true; break;
+      case 't': trace = optarg; break;
+      case 'o': topen = atoi(optarg); break;
+      case 'x': tclose = atoi(optarg); break;
+      case 'v': verbose = true; break;
+      default: fprintf(stderr, "see header of fs_sim.cpp for options\n"); return 1;
+    }
+  }
+  if(!fileSec || DBUF_BYTES % (128*nch*nbs)) { fprintf(stderr, "disk buffer must hold whole blocks\n"); return 1; }
+
+  static c_uSD<mFsReplay<mFsPosix>> sdPosix;
+  static c_uSD<mFsReplay<mFsRam>> sdRam;
+  if(trace && !(posix ? sdPosix.backend().load(trace, topen, tclose) : sdRam.backend().load(trace, topen, tclose)))
+  { fprintf(stderr, "%s: no trace\n", trace); return 1; }
+  int rc = 0, ret;
+  for(const char *p = rates; *p; p += (p[0]==','))
+  { rate = strtoul(p, (char **)&p, 10);
+    if(!rate) { fprintf(stderr, "bad rate list %s\n", rates); return 1; }
+    ret = posix ? simulate(sdPosix, !trace, totSec) : simulate(sdRam, !trace, totSec);
+    if(ret > rc) rc = ret;
+  }
+  return rc;
+}
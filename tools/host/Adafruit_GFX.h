@@ -0,0 +1,26 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host stand-in for the display library: no display attached (menuSetup)
+#ifndef HOST_ADAFRUIT_GFX_H
+#define HOST_ADAFRUIT_GFX_H
+
+#define WHITE 1
+#define BLACK 0
+
+class Adafruit_GFX
+{
+  public:
+    void clearDisplay(void) { }
+    void setTextColor(int) { }
+    void setTextColor(int, int) { }
+    void setTextSize(int) { }
+    void setCursor(int, int) { }
+    template <class T> void print(T) { }
+    template <class T> void println(T) { }
+    void println(void) { }
+    template <class... A> int printf(const char *, A...) { return 0; }
+};
+
+#endif
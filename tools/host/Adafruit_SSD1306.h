@@ -0,0 +1,23 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host stand-in for the SSD1306 display driver
+#ifndef HOST_ADAFRUIT_SSD1306_H
+#define HOST_ADAFRUIT_SSD1306_H
+
+#include "Adafruit_GFX.h"
+
+#define SSD1306_SWITCHCAPVCC 0x2
+#define SSD1306_DISPLAYOFF 0xAE
+
+class Adafruit_SSD1306 : public Adafruit_GFX
+{
+  public:
+    Adafruit_SSD1306(int) { }
+    void begin(int, int) { }
+    void display(void) { }
+    void ssd1306_command(int) { }
+};
+
+#endif
@@ -0,0 +1,109 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host stand-in for the audio library core: block pool (AudioMemory),
+// connections and update_all() in order of construction, as the stock library.
+// host tools without AudioStream objects fill mDiskQueue directly
+#ifndef HOST_AUDIOSTREAM_H
+#define HOST_AUDIOSTREAM_H
+
+#include "core_pins.h"
+
+#define AUDIO_BLOCK_SAMPLES 128
+#define AUDIO_SAMPLE_RATE_EXACT 44117.64706
+
+typedef struct audio_block_struct
+{ uint8_t ref_count;
+  uint8_t reserved1;
+  uint16_t memory_pool_index;
+  int16_t data[AUDIO_BLOCK_SAMPLES];
+} audio_block_t;
+
+class AudioStream;
+class AudioConnection
+{
+  public:
+    AudioConnection(AudioStream &source, unsigned char sourceOutput,
+                    AudioStream &destination, unsigned char destinationInput);
+  private:
+    AudioStream &src, &dst;
+    unsigned char src_index, dest_index;
+    AudioConnection *next_dest;
+    friend class AudioStream;
+};
+
+#define AudioMemory(num) ({ static audio_block_t data[num]; AudioStream::initialize_memory(data, num); })
+#define AudioMemoryUsage() (AudioStream::memoryUsed())
+#define AudioMemoryUsageMax() (AudioStream::memoryUsedMax())
+#define AudioMemoryUsageMaxReset() (AudioStream::memoryUsedMax() = AudioStream::memoryUsed())
+
+class AudioStream
+{
+  public:
+    AudioStream(unsigned char ninput, audio_block_t **iqueue) :
+      num_inputs(ninput), inputQueue(iqueue), destination_list(0), next_update(0)
+    { for(int ii=0; ii<ninput; ii++) inputQueue[ii] = 0;
+      AudioStream **p = &first();
+      while(*p) p = &(*p)->next_update;
+      *p = this;
+    }
+    virtual ~AudioStream() { }
+    virtual void update(void) = 0;
+    static void update_all(void) { for(AudioStream *p = first(); p; p = p->next_update) p->update(); }
+
+    static void initialize_memory(audio_block_t *data, unsigned int num)
+    { pool() = data; poolSize() = num;
+      for(unsigned int ii=0; ii<num; ii++) { data[ii].memory_pool_index = ii; data[ii].ref_count = 0; }
+      memoryUsed() = memoryUsedMax() = 0;
+    }
+    static uint16_t &memoryUsed(void) { static uint16_t n = 0; return n; }
+    static uint16_t &memoryUsedMax(void) { static uint16_t n = 0; return n; }
+
+  protected:
+    static audio_block_t * allocate(void)
+    { for(unsigned int ii=0; ii<poolSize(); ii++)
+        if(!pool()[ii].ref_count)
+        { pool()[ii].ref_count = 1;
+          if(++memoryUsed() > memoryUsedMax()) memoryUsedMax() = memoryUsed();
+          return &pool()[ii];
+        }
+      return 0;
+    }
+    static void release(audio_block_t *block)
+    { if(block && block->ref_count && !--block->ref_count) memoryUsed()--;
+    }
+    void transmit(audio_block_t *block, unsigned char index = 0)
+    { for(AudioConnection *c = destination_list; c; c = c->next_dest)
+        if(c->src_index == index && !c->dst.inputQueue[c->dest_index])
+        { c->dst.inputQueue[c->dest_index] = block;
+          block->ref_count++;
+        }
+    }
+    audio_block_t * receiveReadOnly(unsigned int index = 0)
+    { if(index >= num_inputs) return 0;
+      audio_block_t *in = inputQueue[index];
+      inputQueue[index] = 0;
+      return in;
+    }
+
+  private:
+    unsigned char num_inputs;
+    audio_block_t **inputQueue;
+    AudioConnection *destination_list;
+    AudioStream *next_update;
+    static AudioStream *&first(void) { static AudioStream *p = 0; return p; }
+    static audio_block_t *&pool(void) { static audio_block_t *p = 0; return p; }
+    static unsigned int &poolSize(void) { static unsigned int n = 0; return n; }
+    friend class AudioConnection;
+};
+
+inline AudioConnection::AudioConnection(AudioStream &source, unsigned char sourceOutput,
+                                        AudioStream &destination, unsigned char destinationInput) :
+  src(source), dst(destination), src_index(sourceOutput), dest_index(destinationInput), next_dest(0)
+{ AudioConnection **p = &src.destination_list;
+  while(*p) p = &(*p)->next_dest;
+  *p = this;
+}
+
+#endif
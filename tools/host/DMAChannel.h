@@ -0,0 +1,97 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host stand-in for DMA channels: only the I2S0 receive request is served.
+// while the receiver is enabled, each half of the major loop is filled from
+// hostI2SSource at the frame rate of the I2S0 dividers (MDR, TCR2 with 32 bit
+// slots, as set by i2s_mods.h), then the channel interrupt runs (INTHALF and
+// INTMAJOR). minor loops of 2 bytes take the upper half of the slot.
+#ifndef HOST_DMACHANNEL_H
+#define HOST_DMACHANNEL_H
+
+#include "kinetis.h"
+
+#define DMAMUX_SOURCE_I2S0_RX 12
+#define DMA_TCD_ATTR_SSIZE(n) (((n) & 7) << 8)
+#define DMA_TCD_ATTR_DSIZE(n) ((n) & 7)
+#define DMA_TCD_CSR_INTMAJOR 0x02
+#define DMA_TCD_CSR_INTHALF 0x04
+
+// received slots (left, right per frame, left justified 32 bit) of nframes
+static void (*hostI2SSource)(uint32_t *slots, int nframes) = 0;
+
+// frame rate of the I2S0 clock dividers, 0 while the receiver is stopped
+static inline double hostI2SRate(void)
+{ if(!(I2S0_RCSR & I2S_RCSR_RE) || !(SIM_SCGC6 & SIM_SCGC6_I2S) || !I2S0_MDR) return 0;
+  double fcpu = (F_CPU==48000000 || F_CPU==24000000) ? 96000000 : F_CPU; // PLL
+  uint32_t fract = (I2S0_MDR >> 12) & 0xff, divide = I2S0_MDR & 0xfff, div = I2S0_TCR2 & 0xff;
+  return fcpu*(fract+1)/(divide+1)/2/(div+1)/64;
+}
+
+class DMAChannel
+{
+public:
+  typedef struct
+  { volatile const void * volatile SADDR;
+    int16_t SOFF;
+    uint16_t ATTR;
+    uint32_t NBYTES_MLNO;
+    int32_t SLAST;
+    volatile void * volatile DADDR;
+    int16_t DOFF;
+    uint16_t CITER_ELINKNO;
+    int32_t DLASTSGA;
+    uint16_t CSR;
+    uint16_t BITER_ELINKNO;
+  } TCD_t;
+  TCD_t *TCD;
+
+  DMAChannel(bool = true) : TCD(&tcd), isr(0), source(0), pos(0), running(false), irq(0) { memset(&tcd, 0, sizeof(tcd)); }
+  void begin(bool = false) { }
+  void triggerAtHardwareEvent(uint8_t src) { source = src; }
+  void attachInterrupt(void (*fn)(void)) { isr = fn; }
+  void clearInterrupt(void) { }
+  void enable(void)
+  { if(source != DMAMUX_SOURCE_I2S0_RX) return;
+    if(!irq) irq = hostIrqAttach(service, this);
+    irq->due = hostMicros;
+    pos = 0;
+    running = false;
+    irq->on = true;
+  }
+  void disable(void) { if(irq) irq->on = false; }
+
+private:
+  TCD_t tcd;
+  void (*isr)(void);
+  uint8_t source;
+  uint16_t pos; // minor loops of current major loop
+  bool running; // receiver enabled at last service
+  hostIrq *irq;
+
+  static void service(void *ctx)
+  { DMAChannel *d = (DMAChannel *)ctx;
+    double fs = hostI2SRate();
+    uint32_t nslot = d->tcd.BITER_ELINKNO/2;
+    if(!fs || !nslot) { d->running = false; d->irq->due += 1000; return; } // receiver stopped: poll each ms
+    d->irq->due += 1e6*(nslot/2)/fs;
+    if(!d->running) { d->running = true; return; } // first half buffer is being received
+
+    static uint32_t slots[2*4096];
+    if(nslot > sizeof(slots)/4) nslot = sizeof(slots)/4;
+    if(hostI2SSource) hostI2SSource(slots, nslot/2);
+    else memset(slots, 0, nslot*4);
+    uint8_t *dst = (uint8_t *)d->tcd.DADDR;
+    for(uint32_t ii=0; ii<nslot; ii++, dst += d->tcd.DOFF)
+    { if(d->tcd.NBYTES_MLNO == 2) *(int16_t *)dst = (int16_t)(slots[ii] >> 16);
+      else memcpy(dst, &slots[ii], 4);
+    }
+    d->pos += nslot;
+    if(d->pos >= d->tcd.BITER_ELINKNO) { dst += d->tcd.DLASTSGA; d->pos = 0; }
+    d->tcd.DADDR = dst;
+    if(d->isr) d->isr();
+  }
+};
+
+#endif
@@ -0,0 +1,23 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host stand-in for the EEPROM, erased (0xff) unless set by the tool
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+class EEPROMClass
+{
+  public:
+    EEPROMClass(void) { memset(mem, 0xff, sizeof(mem)); }
+    uint8_t read(int idx) { return mem[idx & 4095]; }
+    void write(int idx, uint8_t val) { mem[idx & 4095] = val; }
+  private:
+    uint8_t mem[4096];
+};
+static EEPROMClass EEPROM __attribute__((unused));
+
+#endif
@@ -0,0 +1,23 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host stand-in for the SGTL5000 control of the audio library
+#ifndef HOST_CONTROL_SGTL5000_H
+#define HOST_CONTROL_SGTL5000_H
+
+#define AUDIO_INPUT_LINEIN 0
+#define AUDIO_INPUT_MIC 1
+
+class AudioControlSGTL5000
+{
+  public:
+    bool enable(void) { return true; }
+    bool disable(void) { return true; }
+    bool inputSelect(int) { return true; }
+    bool volume(float) { return true; }
+    bool lineInLevel(uint8_t) { return true; }
+    bool micGain(unsigned int) { return true; }
+};
+
+#endif
@@ -0,0 +1,97 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host stand-in for the Teensy core, so that firmware headers build in the
+// host tools (g++ -Ihost); time is simulated and advanced by the tool
+#ifndef HOST_CORE_PINS_H
+#define HOST_CORE_PINS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "usb_serial.h"
+
+static uint64_t hostMicros = 0; // simulated time
+
+// simulated interrupts: a source is due at 'due' (us) and its handler, which
+// sets the next due time, runs when the simulated time passes it. this happens
+// in hostAdvance (write latencies of mfs_host.h, delay) and hostWait (wfi),
+// so handlers interrupt the firmware where it would wait on hardware
+struct hostIrq
+{ double due;
+  bool on;
+  void (*fn)(void *ctx);
+  void *ctx;
+};
+#define HOST_NIRQ 8
+static hostIrq hostIrqs[HOST_NIRQ];
+static int hostNirq = 0;
+static bool hostInIrq = false;
+
+static inline hostIrq *hostIrqAttach(void (*fn)(void *), void *ctx)
+{ if(hostNirq >= HOST_NIRQ) { fprintf(stderr, "host: too many interrupt sources\n"); exit(1); }
+  hostIrq *q = &hostIrqs[hostNirq++];
+  q->due = 0; q->on = false; q->fn = fn; q->ctx = ctx;
+  return q;
+}
+// earliest enabled source due at or before t
+static inline hostIrq *hostIrqNext(double t)
+{ hostIrq *q = 0;
+  for(int ii=0; ii<hostNirq; ii++)
+    if(hostIrqs[ii].on && hostIrqs[ii].due <= t && (!q || hostIrqs[ii].due < q->due)) q = &hostIrqs[ii];
+  return q;
+}
+static inline void hostAdvance(uint64_t us)
+{ uint64_t t = hostMicros + us;
+  if(!hostInIrq) // handlers are not interrupted
+  { hostIrq *q;
+    while((q = hostIrqNext((double)t)))
+    { if(q->due > hostMicros) hostMicros = (uint64_t)q->due;
+      hostInIrq = true;
+      q->fn(q->ctx);
+      hostInIrq = false;
+    }
+  }
+  hostMicros = t;
+}
+// wfi: time passes until the next interrupt, false if none is enabled
+static inline bool hostWait(void)
+{ hostIrq *q = hostIrqNext(1e300);
+  if(!q) return false;
+  uint64_t t = (uint64_t)q->due;
+  if(t < q->due) t++;
+  hostAdvance(t > hostMicros ? t - hostMicros : 0);
+  return true;
+}
+// the firmware waits with asm("wfi"): no-op on the host, the tool calls
+// hostWait when loop() returns without the simulated time having advanced
+__asm__(".macro wfi\n.endm");
+
+static inline uint32_t micros(void) { return (uint32_t)hostMicros; }
+static inline uint32_t millis(void) { return (uint32_t)(hostMicros/1000); }
+static inline void delay(uint32_t ms) { hostAdvance((uint64_t)ms*1000); }
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define INPUT_DISABLE 5
+#define LOW 0
+#define HIGH 1
+
+// pins read high (pull-ups, no buttons pressed), analog inputs mid-scale
+static uint8_t hostPin[64] __attribute__((unused));
+static inline void pinMode(uint8_t pin, uint8_t mode) { if(mode==INPUT_PULLUP) hostPin[pin&63] = 1; }
+static inline void digitalWriteFast(uint8_t pin, uint8_t val) { hostPin[pin&63] = val; }
+static inline uint8_t digitalReadFast(uint8_t pin) { return hostPin[pin&63]; }
+static inline uint8_t digitalRead(uint8_t pin) { return hostPin[pin&63]; }
+static int hostAnalogRes = 10;
+static inline int analogRead(uint8_t) { return 1 << (hostAnalogRes-1); }
+static inline void analogReference(uint8_t) { }
+static inline void analogReadRes(unsigned int bits) { hostAnalogRes = bits; }
+
+#endif
@@ -0,0 +1,100 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host stand-in for the stock I2S input of the audio library: same DMA setup
+// (16 bit minor loops into a buffer of one block of frames), the interrupt
+// fills left and right blocks per half buffer and runs update_all()
+#ifndef HOST_INPUT_I2S_H
+#define HOST_INPUT_I2S_H
+
+#include "AudioStream.h"
+#include "DMAChannel.h"
+
+class AudioInputI2S : public AudioStream
+{
+  public:
+    AudioInputI2S(void) : AudioStream(0, NULL) { begin(); }
+    virtual void update(void);
+    void begin(void);
+  protected:
+    static bool update_responsibility;
+    static DMAChannel dma;
+    static void isr(void);
+  private:
+    static audio_block_t *block_left, *block_right;
+    static uint16_t block_offset;
+    static uint32_t rx_buffer[AUDIO_BLOCK_SAMPLES];
+};
+bool AudioInputI2S::update_responsibility = false;
+DMAChannel AudioInputI2S::dma(false);
+audio_block_t * AudioInputI2S::block_left = NULL;
+audio_block_t * AudioInputI2S::block_right = NULL;
+uint16_t AudioInputI2S::block_offset = 0;
+uint32_t AudioInputI2S::rx_buffer[AUDIO_BLOCK_SAMPLES];
+
+inline void AudioInputI2S::begin(void)
+{
+  SIM_SCGC6 |= SIM_SCGC6_I2S; // dividers are set by I2S_modification
+  dma.TCD->NBYTES_MLNO = 2;
+  dma.TCD->DADDR = rx_buffer;
+  dma.TCD->DOFF = 2;
+  dma.TCD->CITER_ELINKNO = sizeof(rx_buffer) / 2;
+  dma.TCD->DLASTSGA = -sizeof(rx_buffer);
+  dma.TCD->BITER_ELINKNO = sizeof(rx_buffer) / 2;
+  dma.TCD->CSR = DMA_TCD_CSR_INTHALF | DMA_TCD_CSR_INTMAJOR;
+  dma.triggerAtHardwareEvent(DMAMUX_SOURCE_I2S0_RX);
+  update_responsibility = true;
+  dma.enable();
+  I2S0_RCSR |= I2S_RCSR_RE | I2S_RCSR_BCE | I2S_RCSR_FRDE | I2S_RCSR_FR;
+  I2S0_TCSR |= I2S_TCSR_TE | I2S_TCSR_BCE;
+  dma.attachInterrupt(isr);
+}
+
+inline void AudioInputI2S::isr(void)
+{
+  uint8_t *daddr = (uint8_t *)dma.TCD->DADDR;
+  const int16_t *src = (daddr < (uint8_t *)rx_buffer + sizeof(rx_buffer) / 2) ?
+                       (const int16_t *)&rx_buffer[AUDIO_BLOCK_SAMPLES/2] : (const int16_t *)&rx_buffer[0];
+  if (block_left && block_right) {
+    uint16_t offset = block_offset;
+    if (offset <= AUDIO_BLOCK_SAMPLES/2) {
+      for (int ii = 0; ii < AUDIO_BLOCK_SAMPLES/2; ii++) {
+        block_left->data[offset + ii] = src[2*ii];
+        block_right->data[offset + ii] = src[2*ii + 1];
+      }
+      block_offset = offset + AUDIO_BLOCK_SAMPLES/2;
+    }
+  }
+  if (update_responsibility) AudioStream::update_all();
+}
+
+inline void AudioInputI2S::update(void)
+{
+  audio_block_t *new_left = allocate(), *new_right = NULL;
+  if (new_left) {
+    new_right = allocate();
+    if (!new_right) { release(new_left); new_left = NULL; }
+  }
+  if (block_offset >= AUDIO_BLOCK_SAMPLES) {
+    audio_block_t *out_left = block_left, *out_right = block_right;
+    block_left = new_left;
+    block_right = new_right;
+    block_offset = 0;
+    transmit(out_left, 0);
+    release(out_left);
+    transmit(out_right, 1);
+    release(out_right);
+  } else if (new_left) {
+    if (!block_left) {
+      block_left = new_left;
+      block_right = new_right;
+      block_offset = 0;
+    } else {
+      release(new_left);
+      release(new_right);
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,130 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host stand-in for the Kinetis registers used by the firmware:
+// RTC seconds and DWT cycle counter follow the simulated time of core_pins.h,
+// the RTC seconds interrupt is simulated, all other registers only hold values
+#ifndef HOST_KINETIS_H
+#define HOST_KINETIS_H
+
+#include "core_pins.h"
+
+#ifndef F_CPU
+  #define F_CPU 96000000
+#endif
+
+#define HOST_REG static volatile uint32_t __attribute__((unused))
+
+// RTC: seconds counter can be set (menu), prescaler counts 32768 Hz
+struct hostRtc
+{ uint32_t off;
+  operator uint32_t() const { return off + (uint32_t)(hostMicros/1000000); }
+  hostRtc &operator=(uint32_t t) { off = t - (uint32_t)(hostMicros/1000000); return *this; }
+};
+static hostRtc RTC_TSR __attribute__((unused));
+#define RTC_TPR ((uint32_t)((hostMicros%1000000)*32768/1000000))
+HOST_REG RTC_TAR, RTC_IER, RTC_CR, RTC_SR;
+#define RTC_IER_TSIE 0x10
+#define RTC_CR_OSCE 0x100
+
+#define ARM_DWT_CYCCNT ((uint32_t)(hostMicros*(F_CPU/1000000)))
+HOST_REG ARM_DEMCR, ARM_DWT_CTRL;
+#define ARM_DEMCR_TRCENA (1<<24)
+#define ARM_DWT_CTRL_CYCCNTENA 1
+
+// interrupts are only taken while the simulated time advances, so code is
+// never preempted between two statements that do not wait
+#define __disable_irq() do { } while(0)
+#define __enable_irq() do { } while(0)
+
+#define IRQ_LLWU 21
+#define IRQ_RTC_ALARM 46
+#define IRQ_RTC_SECOND 47
+#define HOST_NVEC 112
+static void (*hostVector[HOST_NVEC])(void);
+static bool hostNvic[HOST_NVEC];
+static inline void attachInterruptVector(int irq, void (*fn)(void)) { hostVector[irq] = fn; }
+#define NVIC_ENABLE_IRQ(n) (hostNvic[n] = true)
+#define NVIC_DISABLE_IRQ(n) (hostNvic[n] = false)
+#define NVIC_SET_PRIORITY(n, p) do { } while(0)
+#define NVIC_CLEAR_PENDING(n) do { } while(0)
+
+// RTC seconds interrupt at each increment of RTC_TSR
+static void hostRtcSecond(void *ctx)
+{ hostIrq *q = (hostIrq *)ctx;
+  q->due += 1e6;
+  if((RTC_IER & RTC_IER_TSIE) && hostNvic[IRQ_RTC_SECOND] && hostVector[IRQ_RTC_SECOND])
+    hostVector[IRQ_RTC_SECOND]();
+}
+static struct hostRtcIrq
+{ hostRtcIrq(void) { hostIrq *q = hostIrqAttach(hostRtcSecond, 0); q->ctx = q; q->due = 1e6; q->on = true; }
+} hostRtcIrqInit __attribute__((unused));
+
+// clock gating, power modes and wake-up (hibernate.h)
+HOST_REG SIM_SCGC6, SIM_SCGC7, SIM_SOPT1, SIM_SOPT1CFG;
+#define SIM_SCGC6_RTC (1<<29)
+#define SIM_SCGC6_I2S (1<<15)
+#define SIM_SCGC6_DMAMUX (1<<1)
+#define SIM_SCGC7_DMA (1<<1)
+#define SIM_SOPT1_USBSSTBY (1<<30)
+#define SIM_SOPT1CFG_USSWE (1<<26)
+HOST_REG LLWU_PE1, LLWU_PE2, LLWU_PE3, LLWU_PE4, LLWU_ME, LLWU_F3;
+HOST_REG MCG_C6, SYST_CSR, SCB_SCR, SMC_PMPROT, SMC_PMCTRL, SMC_VLLSCTRL;
+#define MCG_C6_CME0 0x20
+#define SYST_CSR_TICKINT 2
+#define SMC_PMCTRL_STOPM(n) ((n) & 7)
+#define SMC_VLLSCTRL_VLLSM(n) ((n) & 7)
+HOST_REG PORTA_PCR0, PORTA_PCR1, PORTA_PCR2, PORTA_PCR3, PORTB_PCR2, PORTB_PCR3;
+HOST_REG CORE_PIN9_CONFIG, CORE_PIN11_CONFIG, CORE_PIN13_CONFIG, CORE_PIN23_CONFIG;
+#define PORT_PCR_MUX(n) (((n) & 7) << 8)
+#define DMAMEM
+
+// I2S0: the receive DMA of DMAChannel.h runs at the frame rate of MDR and TCR2
+HOST_REG I2S0_TCSR, I2S0_TCR1, I2S0_TCR2, I2S0_TCR3, I2S0_TCR4, I2S0_TCR5, I2S0_TMR;
+HOST_REG I2S0_RCSR, I2S0_RCR1, I2S0_RCR2, I2S0_RCR3, I2S0_RCR4, I2S0_RCR5, I2S0_RMR;
+HOST_REG I2S0_MCR, I2S0_MDR, I2S0_RDR0;
+#define I2S_TCSR_TE (1u<<31)
+#define I2S_TCSR_BCE (1<<28)
+#define I2S_RCSR_RE (1u<<31)
+#define I2S_RCSR_BCE (1<<28)
+#define I2S_RCSR_FR (1<<25)
+#define I2S_RCSR_FRDE (1<<0)
+#define I2S_MCR_MICS(n) (((n) & 3) << 24)
+#define I2S_MCR_MOE (1<<30)
+#define I2S_MCR_DUF (1<<31)
+#define I2S_MDR_FRACT(n) (((n) & 0xff) << 12)
+#define I2S_MDR_DIVIDE(n) ((n) & 0xfff)
+#define I2S_TCR1_TFW(n) ((n) & 7)
+#define I2S_TCR2_SYNC(n) (((n) & 3) << 30)
+#define I2S_TCR2_MSEL(n) (((n) & 3) << 26)
+#define I2S_TCR2_BCP (1<<25)
+#define I2S_TCR2_BCD (1<<24)
+#define I2S_TCR2_DIV(n) ((n) & 0xff)
+#define I2S_TCR3_TCE (1<<16)
+#define I2S_TCR4_FRSZ(n) (((n) & 0x1f) << 16)
+#define I2S_TCR4_SYWD(n) (((n) & 0x1f) << 8)
+#define I2S_TCR4_MF (1<<4)
+#define I2S_TCR4_FSE (1<<3)
+#define I2S_TCR4_FSP (1<<1)
+#define I2S_TCR4_FSD (1<<0)
+#define I2S_TCR5_WNW(n) (((n) & 0x1f) << 24)
+#define I2S_TCR5_W0W(n) (((n) & 0x1f) << 16)
+#define I2S_TCR5_FBT(n) (((n) & 0x1f) << 8)
+#define I2S_RCR1_RFW(n) ((n) & 7)
+#define I2S_RCR2_SYNC(n) (((n) & 3) << 30)
+#define I2S_RCR2_MSEL(n) (((n) & 3) << 26)
+#define I2S_RCR2_BCD (1<<24)
+#define I2S_RCR2_DIV(n) ((n) & 0xff)
+#define I2S_RCR3_RCE (1<<16)
+#define I2S_RCR4_FRSZ(n) (((n) & 0x1f) << 16)
+#define I2S_RCR4_SYWD(n) (((n) & 0x1f) << 8)
+#define I2S_RCR4_MF (1<<4)
+#define I2S_RCR4_FSE (1<<3)
+#define I2S_RCR4_FSP (1<<1)
+#define I2S_RCR4_FSD (1<<0)
+#define I2S_RCR5_WNW(n) (((n) & 0x1f) << 24)
+#define I2S_RCR5_W0W(n) (((n) & 0x1f) << 16)
+#define I2S_RCR5_FBT(n) (((n) & 0x1f) << 8)
+
+#endif
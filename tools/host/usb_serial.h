@@ -0,0 +1,28 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host stand-in for the USB serial port: output goes to stdout
+#ifndef HOST_USB_SERIAL_H
+#define HOST_USB_SERIAL_H
+
+#include <stdio.h>
+#include <stdarg.h>
+
+struct hostSerial
+{ int printf(const char *fmt, ...)
+  { va_list ap; va_start(ap, fmt); int n = vprintf(fmt, ap); va_end(ap); return n; }
+  void print(const char *s) { ::printf("%s", s); }
+  void print(int v) { ::printf("%d", v); }
+  void print(unsigned int v) { ::printf("%u", v); }
+  void print(long v) { ::printf("%ld", v); }
+  void print(unsigned long v) { ::printf("%lu", v); }
+  void print(double v) { ::printf("%.2f", v); }
+  template <class T> void println(T v) { print(v); ::printf("\n"); }
+  void println(void) { ::printf("\n"); }
+  void flush(void) { fflush(stdout); }
+  operator bool() { return true; }
+};
+static hostSerial Serial __attribute__((unused));
+
+#endif
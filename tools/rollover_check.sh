@@ -0,0 +1,23 @@
+#!/bin/sh
+# SGTL5000 Recorder for Teensy 3.X
+# MIT License, see LICENSE
+
+# host check: file rollover under write stalls (fs_sim.cpp)
+#
+# sh rollover_check.sh
+#
+# 192 kHz, 1 channel, 16 bit, 1 s per file for 2 h: 7199 rollovers, the next
+# file is created in idle while the 300 ms stalls of stall.trace are replayed
+# on the disk buffers of the Teensy 3.6 defaults (NDBUF 12 x DBUF_BYTES 16384).
+# exit code 0: no block dropped and a new file every second
+
+cd "$(dirname "$0")" || exit 1
+out=${TMPDIR:-/tmp}/rollover_check.$$
+trap 'rm -f "$out" "$out.log"' EXIT
+g++ -std=c++14 -O2 -Ihost -DNDBUF=12 -DDBUF_BYTES=16384 -o "$out" fs_sim.cpp || exit 1
+"$out" -r 192000 -c 1 -s 2 -f 1 -d 7200 -t stall.trace -o 20000 -x 10000 >"$out.log"
+rc=$?
+cat "$out.log"
+[ $rc -eq 0 ] || { echo "rollover_check: blocks dropped"; exit 1; }
+tail -n 1 "$out.log" | grep -q "dropped 0; rollovers 7199;" || { echo "rollover_check: unexpected result"; exit 1; }
+echo "rollover_check: ok"
@@ -0,0 +1,96 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host check: recording schedule (m_sched.h) against a brute-force reference
+//
+// g++ -std=c++14 -O2 -o sched_check sched_check.cpp
+//
+// sched_check [ntrial]
+// random schedules (duty cycle, start date, 0..MS_NWIN daily windows, also
+// over midnight) are evaluated second by second for two days at random dates
+// between 1970 and 2105, so leap years and century years are crossed.
+// sleepTime, periodStart and periodEnd must agree with the reference. where
+// windows overlap, periodEnd is not checked (see m_sched.h).
+// exit code 0: no mismatch
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../m_sched.h"
+
+struct Ref
+{ uint32_t t0, dur, per;
+  int nw;
+  uint32_t wb[MS_NWIN], wl[MS_NWIN];
+
+  // recording at tt? ps: period start
+  bool overlap(void)
+  { for(int ii=0; ii<nw; ii++)
+      for(int jj=0; jj<nw; jj++)
+        if(ii != jj && (wb[jj] + 86400 - wb[ii]) % 86400 < wl[ii]) return true;
+    return false;
+  }
+
+  bool rec(uint32_t tt, uint32_t *ps)
+  { if(tt < t0) return false;
+    if(nw == 0) { uint32_t ph = (tt - t0) % per; *ps = tt - ph; return ph < dur; }
+    for(int ii=0; ii<nw; ii++)
+      for(int dd=-1; dd<=0; dd++)
+      { int64_t ws = (int64_t)(tt/86400 + dd)*86400 + wb[ii];
+        if(ws > tt || tt - ws >= wl[ii]) continue;
+        uint32_t ph = (tt - ws) % per;
+        if(ph < dur) { *ps = tt - ph; return true; }
+      }
+    return false;
+  }
+};
+
+int main(int argc, char **argv)
+{
+  int ntrial = argc > 1 ? atoi(argv[1]) : 200;
+  int err = 0;
+  srand(3);
+  for(int trial=0; trial<ntrial; trial++)
+  { mSchedule s;
+    Ref r;
+    uint32_t day = rand() % 49700; // 1970 .. 2106
+    uint32_t tt = day*86400 + rand()%86400;
+    if(tt > 0xffffffffu - 3*86400) tt -= 3*86400;
+    r.t0 = (rand()%2) ? tt - 50000 + rand()%100000 : 0;
+    r.dur = 1 + rand()%600;
+    uint32_t intv = (rand()%4 == 0) ? 0 : rand()%3000;
+    r.per = r.dur + intv;
+    s.begin(r.t0, r.dur, intv);
+    r.nw = 0;
+    int nw = rand() % (MS_NWIN+1);
+    for(int ii=0; ii<nw; ii++)
+    { uint32_t a = rand()%1440, b = rand()%1441;
+      if(s.addWindow(a, b))
+      { uint32_t l = ((b + 1440 - a) % 1440)*60;
+        r.wb[r.nw] = a*60; r.wl[r.nw++] = l ? l : 86400;
+      }
+    }
+    bool ovl = r.overlap();
+
+    for(uint32_t t=tt; t<tt+2*86400; t++)
+    { uint32_t ps = 0, d;
+      bool rr = r.rec(t, &ps);
+      uint32_t sl = s.sleepTime(t);
+      const char *what = 0;
+      if(rr != (sl == 0)) what = "sleepTime";
+      else if(rr && s.periodStart(t) != ps) what = "periodStart";
+      else if(rr && !ovl)
+      { // period ends when recording stops or next period starts
+        uint32_t pe = t + 1, p2;
+        while(r.rec(pe, &p2) && p2 == ps) pe++;
+        if(s.periodEnd(t) != pe) what = "periodEnd";
+      }
+      else if(!r.rec(t + sl, &d) || (sl > 1 && r.rec(t + sl - 1, &d))) what = "sleep length";
+      if(what && err++ < 10)
+        printf("trial %d: t %u (day %u) %s wrong (dur %u per %u t0 %u windows %d)\n",
+               trial, t, t/86400, what, r.dur, r.per, r.t0, r.nw);
+    }
+  }
+  printf("%d schedules, %d mismatches\n", ntrial, err);
+  return err ? 1 : 0;
+}
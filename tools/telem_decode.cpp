@@ -0,0 +1,47 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host tool: decode telemetry records (telem.bin, see m_telem.h) to CSV
+//
+// g++ -std=c++14 -O2 -I.. -o telem_decode telem_decode.cpp
+//
+// telem_decode telem.bin > telem.csv
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../m_telem.h"
+
+int main(int argc, char **argv)
+{
+  if(argc != 2) { fprintf(stderr, "usage: %s telem.bin\n", argv[0]); return 1; }
+  FILE *fp = fopen(argv[1], "rb");
+  if(!fp) { perror(argv[1]); return 1; }
+
+  uint32_t head[2];
+  if(fread(head, sizeof(head), 1, fp) != 1 || memcmp(head, "TLM1", 4))
+  { fprintf(stderr, "%s: no telemetry file\n", argv[1]); return 1; }
+  if(head[1] != sizeof(mTelemRecord))
+  { fprintf(stderr, "%s: record size %u, expected %zu\n", argv[1], head[1], sizeof(mTelemRecord)); return 1; }
+
+  printf("time,loops,blocks,dropped,nbuf,queue,audioMem,vin_V,temp_C,lost\n");
+  mTelemRecord r;
+  uint32_t nrec = 0, nlost = 0, prev = 0;
+  while(fread(&r, sizeof(r), 1, fp) == 1)
+  { time_t tt = r.time;
+    struct tm tx;
+    gmtime_r(&tt, &tx);
+    char ts[32];
+    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &tx);
+    printf("%s,%u,%u,%u,%u,%u,%u,%.3f,%.2f,%d\n", ts, r.loops, r.blocks, r.dropped,
+           r.nbuf, r.queue, r.audioMem, r.vin/1000.0, r.temp/100.0, r.flags & MT_LOST);
+    if(r.flags & MT_LOST) nlost++;
+    if(nrec && r.time < prev) fprintf(stderr, "record %u: time goes backwards\n", nrec);
+    prev = r.time;
+    nrec++;
+  }
+  fclose(fp);
+  fprintf(stderr, "%u records, %u with lost records before\n", nrec, nlost);
+  return 0;
+}
@@ -0,0 +1,48 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host check: civil date conversion (mTime.h) against libc gmtime
+//
+// g++ -std=c++14 -O2 -Ihost -o time_check time_check.cpp
+//
+// for every day of the RTC range (1970 .. 2106) at three times of day
+// seconds2tm must match gmtime (date, time, yday, wday; year and month are
+// not offset in mTime) and tm2seconds must return the seconds.
+// exit code 0: no mismatch
+
+#include <stdio.h>
+#include <time.h>
+#include "../mTime.h"
+
+int main(void)
+{
+  int err = 0;
+  const uint32_t sods[] = {0, 45296, 86399}; // 00:00:00, 12:34:56, 23:59:59
+  uint32_t ndays = 0xffffffffu/86400 + 1;
+  for(uint32_t day=0; day<ndays; day++)
+  { for(uint32_t sod : sods)
+    { uint64_t t64 = (uint64_t)day*86400 + sod;
+      if(t64 > 0xffffffffu) break;
+      uint32_t tt = t64;
+      struct tm tx = seconds2tm(tt);
+      time_t tl = tt;
+      struct tm tr;
+      gmtime_r(&tl, &tr);
+      bool ok = tx.tm_year == tr.tm_year+1900 && tx.tm_mon == tr.tm_mon+1 &&
+                tx.tm_mday == tr.tm_mday && tx.tm_hour == tr.tm_hour &&
+                tx.tm_min == tr.tm_min && tx.tm_sec == tr.tm_sec &&
+                tx.tm_yday == tr.tm_yday && tx.tm_wday == tr.tm_wday;
+      if(!ok && err++ < 10)
+        printf("%u: %04d-%02d-%02d %02d:%02d:%02d yday %d wday %d, gmtime %04d-%02d-%02d yday %d wday %d\n",
+               tt, tx.tm_year, tx.tm_mon, tx.tm_mday, tx.tm_hour, tx.tm_min, tx.tm_sec,
+               tx.tm_yday, tx.tm_wday, tr.tm_year+1900, tr.tm_mon+1, tr.tm_mday, tr.tm_yday, tr.tm_wday);
+      if(tm2seconds(&tx) != tt && err++ < 10)
+        printf("%u: tm2seconds gives %u\n", tt, tm2seconds(&tx));
+      struct tm tc = seconds2tm(tt); // cached
+      if(memcmp(&tc, &tx, sizeof(tc)) && err++ < 10) printf("%u: cached value differs\n", tt);
+    }
+  }
+  printf("%u days, %d mismatches\n", ndays, err);
+  return err ? 1 : 0;
+}
@@ -0,0 +1,221 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host tool: concatenate recorder WAV files into one continuous timeline
+//
+// g++ -std=c++14 -O2 -o wav_concat wav_concat.cpp
+//
+// wav_concat [-z] out.wav file.wav ...
+// files may be given in any order, they are sorted by first sample index.
+// option -z: fill gaps and holes with zeros instead of failing
+// exit code 0: gapless, 2: gaps filled with zeros (-z), 1: error
+//
+// each recorder header holds the index of its first sample (s0) within the
+// stream started at acquisition start and the RTC time of stream sample 0 (t0).
+// samples lost in the queue are listed as gaps "pos:len" (pos in stored samples
+// of the file) and count in the index, so for consecutive files
+//   s0(next) == s0 + samples + sum(gap len)
+// files of different streams (t0 differs, e.g. after hibernation) are not joined.
+// the start time uses the sample rate measured against the RTC ("fs" in header),
+// averaged over the files, if present, otherwise the nominal rate.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#define SECTOR 512
+#define INFO 44            // info text in header
+#define STATS (INFO+64)    // statistics and gaps
+#define TIMING (INFO+412)  // "s0 <hex>; t0 <sec>.<us>"
+#define CLOCK (INFO+364)   // "fs <measured>; ..."
+
+struct Gap { uint64_t pos, len; };
+
+struct Input
+{ std::string name;
+  uint8_t h[SECTOR];
+  uint64_t s0;          // stream index of first sample
+  uint32_t t0s, t0u;    // stream epoch
+  double fs;            // measured rate, 0: unknown
+  uint64_t frames;      // stored samples
+  uint64_t lost;        // sum of gaps
+  bool closed;          // gap list valid
+  std::vector<Gap> gaps;
+};
+
+static uint32_t rd32(const uint8_t *p) { return p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24; }
+static uint16_t rd16(const uint8_t *p) { return p[0] | p[1]<<8; }
+static void wr32(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v>>8; p[2] = v>>16; p[3] = v>>24; }
+static void wr16(uint8_t *p, uint16_t v) { p[0] = v; p[1] = v>>8; }
+
+static bool readInput(Input &in)
+{
+  FILE *fd = fopen(in.name.c_str(), "rb");
+  if(!fd) { fprintf(stderr, "%s: cannot open\n", in.name.c_str()); return false; }
+  bool ok = fread(in.h, 1, SECTOR, fd) == SECTOR;
+  fclose(fd);
+  const uint8_t *h = in.h;
+  if(!ok || memcmp(h, "RIFF", 4) || memcmp(h+36, "info", 4) || memcmp(h+504, "data", 4))
+  { fprintf(stderr, "%s: no recorder header\n", in.name.c_str()); return false; }
+
+  char txt[SECTOR-INFO+1] = {0};
+  memcpy(txt, h+INFO, SECTOR-8-INFO);
+  unsigned long long s0;
+  if(sscanf(txt+TIMING-INFO, "s0 %llx; t0 %u.%u", &s0, &in.t0s, &in.t0u) != 3)
+  { fprintf(stderr, "%s: no sample index in header\n", in.name.c_str()); return false; }
+  in.s0 = s0;
+  if(sscanf(txt+CLOCK-INFO, "fs %lf", &in.fs) != 1) in.fs = 0;
+  in.frames = rd32(h+508) / rd16(h+32);
+  in.lost = 0;
+
+  // "drop d, run d, queue d; gaps p:l p:l ...; n"
+  in.closed = !strncmp(txt+STATS-INFO, "drop", 4);
+  if(in.closed)
+  { const char *p = strstr(txt+STATS-INFO, "gaps");
+    p += 4;
+    unsigned long long pos, len;
+    int n;
+    while(sscanf(p, " %llu:%llu%n", &pos, &len, &n) == 2)
+    { in.gaps.push_back({pos, len});
+      in.lost += len;
+      p += n;
+    }
+    if(sscanf(p, "; %d", &n) != 1 || n != (int)in.gaps.size())
+    { fprintf(stderr, "%s: gap list incomplete\n", in.name.c_str());
+      in.closed = false;
+    }
+  }
+  return true;
+}
+
+static bool writeZeros(FILE *fo, uint64_t n, std::vector<uint8_t> &buf)
+{
+  std::fill(buf.begin(), buf.end(), 0);
+  while(n)
+  { size_t nw = std::min<uint64_t>(buf.size(), n);
+    if(fwrite(buf.data(), 1, nw, fo) != nw) return false;
+    n -= nw;
+  }
+  return true;
+}
+
+static bool copyData(FILE *fo, const Input &in, uint64_t from, uint64_t nbytes, std::vector<uint8_t> &buf)
+{
+  FILE *fd = fopen(in.name.c_str(), "rb");
+  if(!fd || fseek(fd, SECTOR + from, SEEK_SET)) { if(fd) fclose(fd); return false; }
+  bool ok = true;
+  while(ok && nbytes)
+  { size_t nr = std::min<uint64_t>(buf.size(), nbytes);
+    ok = fread(buf.data(), 1, nr, fd) == nr && fwrite(buf.data(), 1, nr, fo) == nr;
+    nbytes -= nr;
+  }
+  fclose(fd);
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  bool fill = false;
+  std::vector<std::string> args;
+  for(int ii=1; ii<argc; ii++)
+  { if(!strcmp(argv[ii], "-z")) fill = true;
+    else args.push_back(argv[ii]);
+  }
+  if(args.size() < 2)
+  { fprintf(stderr, "usage: %s [-z] out.wav file.wav ...\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<Input> in(args.size()-1);
+  for(size_t ii=0; ii<in.size(); ii++)
+  { in[ii].name = args[ii+1];
+    if(!readInput(in[ii])) return 1;
+  }
+  std::sort(in.begin(), in.end(), [](const Input &a, const Input &b) { return a.s0 < b.s0; });
+
+  const uint8_t *h0 = in[0].h;
+  uint32_t fs = rd32(h0+24);
+  uint16_t align = rd16(h0+32);
+  for(auto &f : in)
+  { if(f.t0s != in[0].t0s || f.t0u != in[0].t0u)
+    { fprintf(stderr, "%s: different stream (t0 %u.%06u, not %u.%06u)\n",
+              f.name.c_str(), f.t0s, f.t0u, in[0].t0s, in[0].t0u);
+      return 1;
+    }
+    if(memcmp(f.h+20, h0+20, 16))
+    { fprintf(stderr, "%s: different format\n", f.name.c_str()); return 1; }
+  }
+
+  // verify chain
+  uint64_t next = in[0].s0, filled = 0;
+  for(size_t ii=0; ii<in.size(); ii++)
+  { const Input &f = in[ii];
+    if(f.s0 < next)
+    { fprintf(stderr, "%s: overlaps previous file by %llu samples\n",
+              f.name.c_str(), (unsigned long long)(next - f.s0));
+      return 1;
+    }
+    if(f.s0 > next)
+      printf("hole of %llu samples before %s%s\n", (unsigned long long)(f.s0 - next),
+             f.name.c_str(), in[ii-1].closed ? "" : " (previous file not closed)");
+    if(f.lost) printf("%s: %zu gaps, %llu samples lost\n", f.name.c_str(), f.gaps.size(),
+                      (unsigned long long)f.lost);
+    filled += f.s0 - next + f.lost;
+    next = f.s0 + f.frames + f.lost;
+  }
+  uint64_t total = next - in[0].s0;
+  if(filled && !fill)
+  { fprintf(stderr, "timeline not gapless, %llu samples missing (use -z to fill)\n",
+            (unsigned long long)filled);
+    return 1;
+  }
+  if(total*align > 0xffffffffULL - 36)
+  { fprintf(stderr, "output exceeds 4 GB WAV limit\n"); return 1; }
+
+  // write output: plain 44 byte header
+  FILE *fo = fopen(args[0].c_str(), "wb");
+  if(!fo) { perror(args[0].c_str()); return 1; }
+  uint8_t hdr[44];
+  memcpy(hdr, "RIFF", 4); wr32(hdr+4, 36 + total*align);
+  memcpy(hdr+8, h0+8, 28); wr16(hdr+16, 16); // WAVE, fmt
+  memcpy(hdr+36, "data", 4); wr32(hdr+40, total*align);
+  bool ok = fwrite(hdr, 1, 44, fo) == 44;
+
+  std::vector<uint8_t> buf(4 << 20);
+  next = in[0].s0;
+  for(auto &f : in)
+  { ok = ok && writeZeros(fo, (f.s0 - next)*align, buf);
+    uint64_t done = 0;
+    for(auto &g : f.gaps)
+    { uint64_t pos = std::min(g.pos, f.frames);
+      ok = ok && copyData(fo, f, done*align, (pos - done)*align, buf)
+              && writeZeros(fo, g.len*align, buf);
+      done = pos;
+    }
+    ok = ok && copyData(fo, f, done*align, (f.frames - done)*align, buf);
+    next = f.s0 + f.frames + f.lost;
+  }
+  ok = fclose(fo) == 0 && ok;
+  if(!ok) { fprintf(stderr, "%s: write failed\n", args[0].c_str()); return 1; }
+
+  // absolute time of first output sample
+  double fsm = 0, nm = 0;
+  for(auto &f : in) if(f.fs > 0) { fsm += f.fs*f.frames; nm += f.frames; }
+  fsm = nm > 0 ? fsm/nm : fs;
+  uint64_t us = (uint64_t)in[0].t0u + (uint64_t)(in[0].s0 * 1e6 / fsm + 0.5);
+  time_t ts = in[0].t0s + us / 1000000;
+  struct tm tx;
+  gmtime_r(&ts, &tx);
+  printf("%s: %zu files, %llu samples (%.3f s), fs %.4f%s, start %04d-%02d-%02d %02d:%02d:%02d.%06u, %s\n",
+         args[0].c_str(), in.size(), (unsigned long long)total, (double)total/fsm,
+         fsm, nm > 0 ? " measured" : "",
+         tx.tm_year+1900, tx.tm_mon+1, tx.tm_mday, tx.tm_hour, tx.tm_min, tx.tm_sec,
+         (unsigned)(us % 1000000), filled ? "gaps filled with zeros" : "gapless");
+  return filled ? 2 : 0;
+}
@@ -0,0 +1,212 @@
+/* SGTL5000 Recorder for Teensy 3.X
+ * MIT License, see LICENSE
+ */
+
+// host tool: recover recorder WAV files after power loss
+//
+// g++ -std=c++14 -O2 -pthread -o wav_recover wav_recover.cpp
+//
+// wav_recover image.img outdir   scan card image (e.g. dd of the uSD card) for
+//                                recorder headers and write recovered files to outdir
+// wav_recover -f file.wav ...    repair copied files in place (header sizes, file length)
+// option -c: trust checkpoint only, do not extend data beyond last header update
+//
+// a recorder header is a 512 byte WAV header with an 'info' chunk at byte 36
+// starting with the file time (YYYY_MM_DD_hh_mm_ss) and the 'data' chunk at byte 504.
+// info[64] is "drop ..." (statistics) for closed files, "ckpt" for checkpointed
+// open files and "open" before the first checkpoint; dLen is the data written until
+// close or the last checkpoint, 0 before.
+// data of an unclosed file are extended over written (not erased) sectors up to
+// the next recorder header (a digitally silent sector also ends the scan, use the
+// checkpoint if this matters). files are processed in parallel.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SECTOR 512
+#define CHUNK (64 << 20) // bytes per scan job
+
+struct Item
+{ std::string name;  // input file (file mode) or output name (image mode)
+  uint64_t start;    // header position in input
+  uint64_t limit;    // end of input range available to this file
+};
+
+static int fdIn = -1;  // image (image mode)
+static bool ckptOnly = false;
+static std::string outDir;
+
+static uint32_t rd32(const uint8_t *p) { return p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24; }
+static void wr32(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v>>8; p[2] = v>>16; p[3] = v>>24; }
+
+static bool isHeader(const uint8_t *h)
+{
+  if(memcmp(h, "RIFF", 4) || memcmp(h+8, "WAVE", 4) || memcmp(h+12, "fmt ", 4)) return false;
+  if(memcmp(h+36, "info", 4) || memcmp(h+504, "data", 4)) return false;
+  const char *pat = "dddd_dd_dd_dd_dd_dd";
+  for(int ii=0; pat[ii]; ii++)
+  { char c = h[44+ii];
+    if(pat[ii]=='d' ? (c<'0' || c>'9') : c!='_') return false;
+  }
+  return true;
+}
+
+static bool isErased(const uint8_t *s)
+{ // never written sector (erased card or trimmed)
+  uint8_t v = s[0];
+  if(v!=0 && v!=0xff) return false;
+  for(int ii=1; ii<SECTOR; ii++) if(s[ii]!=v) return false;
+  return true;
+}
+
+// data bytes of file with header at 'start' in fd, input available up to 'limit'
+static uint64_t dataBytes(int fd, const uint8_t *h, uint64_t start, uint64_t limit, const char **how)
+{
+  uint64_t dLen = rd32(h+508);
+  uint64_t avail = (limit > start + SECTOR) ? (limit - start - SECTOR) & ~(uint64_t)(SECTOR-1) : 0;
+  uint16_t align = h[32] | h[33]<<8; // nBlockAlign
+  if(!align) align = 1;
+  if(!memcmp(h+44+64, "drop", 4)) { *how = "closed"; return std::min(dLen, avail); }
+  bool ckpt = !memcmp(h+44+64, "ckpt", 4);
+  uint64_t nd = ckpt ? std::min(dLen, avail) : 0;
+  *how = ckpt ? "checkpoint" : "no checkpoint";
+  if(!ckptOnly)
+  { // extend over written sectors
+    std::vector<uint8_t> buf(1 << 20);
+    uint64_t n0 = nd &= ~(uint64_t)(SECTOR-1);
+    while(nd < avail)
+    { size_t nr = std::min<uint64_t>(buf.size(), avail - nd);
+      ssize_t ng = pread(fd, buf.data(), nr, start + SECTOR + nd);
+      if(ng <= 0) break;
+      size_t ii;
+      for(ii=0; ii+SECTOR<=(size_t)ng; ii+=SECTOR)
+        if(isErased(&buf[ii]) || isHeader(&buf[ii])) break;
+      nd += ii;
+      if(ii < (size_t)ng) break;
+    }
+    if(nd > n0) *how = ckpt ? "checkpoint, extended by scan" : "scanned";
+  }
+  if(nd > 0xffffffffULL - SECTOR) nd = 0xffffffffULL - SECTOR;
+  return nd - nd % align;
+}
+
+static bool recover(const Item &it, char *msg)
+{
+  uint8_t h[SECTOR];
+  int fd = fdIn;
+  if(outDir.empty())
+  { fd = open(it.name.c_str(), O_RDWR);
+    if(fd < 0) { sprintf(msg, "%s: cannot open", it.name.c_str()); return false; }
+  }
+  bool ok = false;
+  if(pread(fd, h, SECTOR, it.start) != SECTOR || !isHeader(h))
+    sprintf(msg, "%s: no recorder header", it.name.c_str());
+  else
+  { const char *how;
+    uint64_t nd = dataBytes(fd, h, it.start, it.limit, &how);
+    bool changed = rd32(h+508) != nd;
+    wr32(h+508, nd);
+    wr32(h+4, SECTOR - 8 + nd);
+    if(outDir.empty())
+    { ok = pwrite(fd, h, SECTOR, 0) == SECTOR && ftruncate(fd, SECTOR + nd) == 0;
+    }
+    else
+    { std::string fn = outDir + "/" + it.name;
+      int fo = open(fn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      ok = fo >= 0 && write(fo, h, SECTOR) == SECTOR;
+      std::vector<uint8_t> buf(4 << 20);
+      for(uint64_t ii=0; ok && ii<nd; )
+      { size_t nr = std::min<uint64_t>(buf.size(), nd - ii);
+        ok = pread(fd, buf.data(), nr, it.start + SECTOR + ii) == (ssize_t)nr &&
+             write(fo, buf.data(), nr) == (ssize_t)nr;
+        ii += nr;
+      }
+      if(fo >= 0) close(fo);
+    }
+    sprintf(msg, "%s: %s, %llu data bytes%s%s", it.name.c_str(), how, (unsigned long long)nd,
+            changed ? " (size repaired)" : "", ok ? "" : "; write failed");
+  }
+  if(outDir.empty()) close(fd);
+  return ok;
+}
+
+template <class F>
+static void parallel(size_t n, F f)
+{
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> pool;
+  unsigned nt = std::max(1u, std::thread::hardware_concurrency());
+  for(unsigned ii=0; ii<nt && ii<n; ii++)
+    pool.emplace_back([&]() { for(size_t jj; (jj = next++) < n; ) f(jj); });
+  for(auto &t : pool) t.join();
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<Item> items;
+  std::vector<std::string> args;
+  bool fileMode = false;
+  for(int ii=1; ii<argc; ii++)
+  { if(!strcmp(argv[ii], "-c")) ckptOnly = true;
+    else if(!strcmp(argv[ii], "-f")) fileMode = true;
+    else args.push_back(argv[ii]);
+  }
+  if(fileMode ? args.empty() : args.size()!=2)
+  { fprintf(stderr, "usage: %s [-c] image outdir | %s [-c] -f file.wav ...\n", argv[0], argv[0]);
+    return 1;
+  }
+
+  if(fileMode)
+  { for(auto &fn : args)
+    { struct stat st;
+      if(stat(fn.c_str(), &st)) { fprintf(stderr, "%s: cannot stat\n", fn.c_str()); continue; }
+      items.push_back({fn, 0, (uint64_t)st.st_size});
+    }
+  }
+  else
+  { fdIn = open(args[0].c_str(), O_RDONLY);
+    if(fdIn < 0) { perror(args[0].c_str()); return 1; }
+    outDir = args[1];
+    mkdir(outDir.c_str(), 0755);
+    uint64_t size = lseek(fdIn, 0, SEEK_END);
+    // scan image for headers, chunks in parallel
+    size_t nchunk = (size + CHUNK - 1) / CHUNK;
+    std::vector<std::vector<uint64_t>> found(nchunk);
+    parallel(nchunk, [&](size_t ic)
+    { std::vector<uint8_t> buf(CHUNK);
+      ssize_t ng = pread(fdIn, buf.data(), CHUNK, (uint64_t)ic*CHUNK);
+      for(ssize_t ii=0; ii+SECTOR<=ng; ii+=SECTOR)
+        if(isHeader(&buf[ii])) found[ic].push_back((uint64_t)ic*CHUNK + ii);
+    });
+    std::vector<uint64_t> pos;
+    for(auto &f : found) pos.insert(pos.end(), f.begin(), f.end());
+    for(size_t ii=0; ii<pos.size(); ii++)
+    { uint8_t h[SECTOR];
+      if(pread(fdIn, h, SECTOR, pos[ii]) != SECTOR) continue;
+      char name[64];
+      snprintf(name, sizeof(name), "%.19s_%010llu.wav", (char*)h+44, (unsigned long long)(pos[ii]/SECTOR));
+      items.push_back({name, pos[ii], ii+1<pos.size() ? pos[ii+1] : size});
+    }
+    printf("%zu recorder headers found\n", items.size());
+  }
+
+  std::vector<std::string> msgs(items.size());
+  std::atomic<int> nfail(0);
+  parallel(items.size(), [&](size_t ii)
+  { char msg[512];
+    if(!recover(items[ii], msg)) nfail++;
+    msgs[ii] = msg;
+  });
+  for(auto &m : msgs) printf("%s\n", m.c_str());
+  if(fdIn >= 0) close(fdIn);
+  return nfail ? 2 : 0;
+}